@@ -9,6 +9,10 @@ uniform vec3 uSelected;
 void main()
 {
 	outColor = texture(blockTextures, tc);
+	//See through parts of transparent blocks, faces are
+	//not sorted so they can not be blended
+	if(outColor.a < 0.5)
+		discard;
 	
 	if(fract(abs(fragPos.x)) == 0.0) 
 	{
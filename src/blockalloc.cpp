@@ -0,0 +1,211 @@
+#include "blockalloc.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+const size_t SLAB_SIZE = size_t(2) << 20;
+//Size classes are 64, 128, 256 and 512 words
+const uint32_t SIZE_CLASSES = 4;
+
+struct FreeBlock
+{
+	FreeBlock *next;
+};
+
+//Every slab only holds blocks of one size class
+struct Slab
+{
+	char *base;
+	uint32_t sizeClass;
+	//Blocks that are handed out
+	uint32_t live = 0;
+	//Bytes at the start of the slab that have been handed out at least
+	//once, the rest has never been touched and is not resident yet
+	size_t carved = 0;
+	//Blocks below carved that were freed
+	FreeBlock *freeBlocks = nullptr;
+	//Slabs of the size class that have room, see partialSlabs
+	Slab *prev = nullptr, *next = nullptr;
+};
+
+static std::mutex allocMutex;
+//Slab base address -> slab
+static std::unordered_map<uintptr_t, Slab> slabs;
+//Slabs of each size class that have room for another block
+static Slab *partialSlabs[SIZE_CLASSES] = { nullptr };
+//Slabs of each size class with no live blocks, one is kept
+//so that a size class going back and forth between empty
+//and one block does not map and unmap a slab every time
+static uint32_t emptySlabs[SIZE_CLASSES] = { 0 };
+static size_t reserved = 0;
+
+static uint32_t sizeClass(uint32_t words)
+{
+	uint32_t sc = 0;
+	while((64u << sc) < words)
+		sc++;
+	return sc;
+}
+
+static size_t blockBytes(uint32_t sc)
+{
+	return size_t(64u << sc) * sizeof(uint64_t);
+}
+
+static void* allocSlab()
+{
+#ifdef _WIN32
+	void *slab = _aligned_malloc(SLAB_SIZE, SLAB_SIZE);
+	if(!slab)
+		throw std::bad_alloc();
+	return slab;
+#else
+	//Map twice the size and unmap the ends to get an aligned slab,
+	//slabs are mapped directly so freeing one gives it back to the OS
+	void *mapped = mmap(nullptr, SLAB_SIZE * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(mapped == MAP_FAILED)
+		throw std::bad_alloc();
+	uintptr_t start = uintptr_t(mapped),
+			  aligned = (start + SLAB_SIZE - 1) & ~uintptr_t(SLAB_SIZE - 1);
+	if(aligned > start)
+		munmap(mapped, aligned - start);
+	if(aligned + SLAB_SIZE < start + SLAB_SIZE * 2)
+		munmap((void*)(aligned + SLAB_SIZE), start + SLAB_SIZE * 2 - aligned - SLAB_SIZE);
+	void *slab = (void*)aligned;
+#ifdef MADV_HUGEPAGE
+	madvise(slab, SLAB_SIZE, MADV_HUGEPAGE);
+#endif
+	return slab;
+#endif
+}
+
+static void freeSlab(void *slab)
+{
+#ifdef _WIN32
+	_aligned_free(slab);
+#else
+	munmap(slab, SLAB_SIZE);
+#endif
+}
+
+static void linkSlab(Slab *slab)
+{
+	slab->prev = nullptr;
+	slab->next = partialSlabs[slab->sizeClass];
+	if(slab->next)
+		slab->next->prev = slab;
+	partialSlabs[slab->sizeClass] = slab;
+}
+
+static void unlinkSlab(Slab *slab)
+{
+	if(slab->prev)
+		slab->prev->next = slab->next;
+	else
+		partialSlabs[slab->sizeClass] = slab->next;
+	if(slab->next)
+		slab->next->prev = slab->prev;
+	slab->prev = slab->next = nullptr;
+}
+
+static bool isFull(const Slab *slab)
+{
+	return !slab->freeBlocks && slab->carved + blockBytes(slab->sizeClass) > SLAB_SIZE;
+}
+
+uint64_t* allocSectionData(uint32_t words)
+{
+	uint32_t sc = sizeClass(words);
+	size_t bytes = blockBytes(sc);
+
+	uint64_t *data;
+	{
+		std::lock_guard<std::mutex> lock(allocMutex);
+		Slab *slab = partialSlabs[sc];
+		if(!slab)
+		{
+			char *base = (char*)allocSlab();
+			reserved += SLAB_SIZE;
+			slab = &slabs[uintptr_t(base)];
+			slab->base = base;
+			slab->sizeClass = sc;
+			linkSlab(slab);
+			emptySlabs[sc]++;
+		}
+
+		//Reuse freed blocks before touching new memory
+		if(slab->freeBlocks)
+		{
+			data = (uint64_t*)slab->freeBlocks;
+			slab->freeBlocks = slab->freeBlocks->next;
+		}
+		else
+		{
+			data = (uint64_t*)(slab->base + slab->carved);
+			slab->carved += bytes;
+		}
+
+		if(slab->live++ == 0)
+			emptySlabs[sc]--;
+		if(isFull(slab))
+			unlinkSlab(slab);
+	}
+
+	memset(data, 0, bytes);
+	return data;
+}
+
+void freeSectionData(uint64_t *data, uint32_t words)
+{
+	if(!data)
+		return;
+
+	uint32_t sc = sizeClass(words);
+	std::lock_guard<std::mutex> lock(allocMutex);
+	auto it = slabs.find(uintptr_t(data) & ~uintptr_t(SLAB_SIZE - 1));
+	if(it == slabs.end())
+		return;
+
+	Slab *slab = &it->second;
+	if(isFull(slab))
+		linkSlab(slab);
+	FreeBlock *block = (FreeBlock*)data;
+	block->next = slab->freeBlocks;
+	slab->freeBlocks = block;
+
+	if(--slab->live > 0)
+		return;
+
+	//Give empty slabs back to the OS, except for one per size class
+	if(emptySlabs[sc] > 0)
+	{
+		unlinkSlab(slab);
+		freeSlab(slab->base);
+		reserved -= SLAB_SIZE;
+		slabs.erase(it);
+	}
+	else
+	{
+		//Keep the address range but let go of the pages
+		emptySlabs[sc]++;
+#ifndef _WIN32
+		madvise(slab->base, slab->carved, MADV_DONTNEED);
+		slab->carved = 0;
+		slab->freeBlocks = nullptr;
+#endif
+	}
+}
+
+size_t sectionDataReserved()
+{
+	std::lock_guard<std::mutex> lock(allocMutex);
+	return reserved;
+}
@@ -0,0 +1,25 @@
+#ifndef __BLOCKALLOC_H__
+#include <stdint.h>
+#include <stddef.h>
+
+//Allocator for the packed block data of chunk sections.
+//Memory is carved out of 2 MiB slabs that are aligned and
+//marked for transparent huge pages (where the OS supports it)
+//so that walking a large world touches fewer TLB entries.
+//Each slab holds blocks of one size, freed blocks are reused and
+//slabs that no longer hold any blocks are returned to the OS (one
+//empty slab per size is kept, without its pages). Only the part of a
+//slab that has been handed out is touched, so it is the part in memory.
+//Safe to call from multiple threads.
+
+//Returns zeroed memory for `words` 64 bit words,
+//words has to be 64, 128, 256 or 512
+uint64_t* allocSectionData(uint32_t words);
+void freeSectionData(uint64_t *data, uint32_t words);
+//Returns the number of bytes reserved from the OS for section data,
+//including free blocks and slabs that are kept empty
+size_t sectionDataReserved();
+
+#endif
+
+#define __BLOCKALLOC_H__
@@ -0,0 +1,252 @@
+#include "blockentity.hpp"
+#include <string.h>
+#include <algorithm>
+
+//Size of the table once the first entity is added
+const size_t INITIAL_TABLE_SIZE = 8;
+//Bytes written per entity before its payload (key, block, size)
+const size_t ENTITY_HEADER_BYTES = sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint32_t);
+
+//Mixes every bit of the key into every bit of the hash (the murmur3
+//finalizer), the table is indexed with the low bits
+static uint32_t hashKey(uint32_t key)
+{
+	key ^= key >> 16;
+	key *= 0x85ebca6bu;
+	key ^= key >> 13;
+	key *= 0xc2b2ae35u;
+	key ^= key >> 16;
+	return key;
+}
+
+size_t BlockEntityMap::findSlot(uint32_t key) const
+{
+	size_t mask = table.size() - 1;
+	size_t i = hashKey(key) & mask;
+	while(table[i] != 0 && entities[table[i] - 1].key != key)
+		i = (i + 1) & mask;
+	return i;
+}
+
+void BlockEntityMap::rehash(size_t capacity)
+{
+	table.assign(capacity, 0);
+	for(size_t i = 0; i < entities.size(); i++)
+		table[findSlot(entities[i].key)] = uint32_t(i + 1);
+}
+
+void BlockEntityMap::compactPayloads()
+{
+	std::vector<uint8_t> compacted;
+	compacted.reserve(payloads.size() - garbageBytes);
+	for(auto &entity : entities)
+	{
+		uint32_t offset = compacted.size();
+		compacted.insert(compacted.end(),
+						 payloads.begin() + entity.offset,
+						 payloads.begin() + entity.offset + entity.size);
+		entity.offset = offset;
+	}
+	payloads = std::move(compacted);
+	garbageBytes = 0;
+}
+
+bool BlockEntityMap::empty() const
+{
+	return entities.empty();
+}
+
+size_t BlockEntityMap::size() const
+{
+	return entities.size();
+}
+
+const BlockEntity* BlockEntityMap::find(uint32_t key) const
+{
+	if(entities.empty())
+		return nullptr;
+
+	size_t slot = findSlot(key);
+	if(table[slot] == 0)
+		return nullptr;
+	return &entities[table[slot] - 1];
+}
+
+const std::vector<BlockEntity>& BlockEntityMap::all() const
+{
+	return entities;
+}
+
+uint8_t* BlockEntityMap::payload(const BlockEntity &entity)
+{
+	return payloads.data() + entity.offset;
+}
+
+const uint8_t* BlockEntityMap::payload(const BlockEntity &entity) const
+{
+	return payloads.data() + entity.offset;
+}
+
+void BlockEntityMap::set(uint32_t key, uint8_t block, const uint8_t *data, uint32_t size)
+{
+	//Keep the table at most half full
+	if((entities.size() + 1) * 2 > table.size())
+		rehash(std::max(INITIAL_TABLE_SIZE, table.size() * 2));
+
+	size_t slot = findSlot(key);
+	if(table[slot] != 0)
+	{
+		BlockEntity &entity = entities[table[slot] - 1];
+		entity.block = block;
+		//Reuse the old payload if the new one fits
+		if(size <= entity.size)
+		{
+			garbageBytes += entity.size - size;
+			entity.size = size;
+			memcpy(payloads.data() + entity.offset, data, size);
+			return;
+		}
+
+		garbageBytes += entity.size;
+		entity.offset = payloads.size();
+		entity.size = size;
+		payloads.insert(payloads.end(), data, data + size);
+	}
+	else
+	{
+		table[slot] = uint32_t(entities.size() + 1);
+		entities.push_back({ key, block, uint32_t(payloads.size()), size });
+		payloads.insert(payloads.end(), data, data + size);
+	}
+
+	if(garbageBytes * 2 > payloads.size())
+		compactPayloads();
+}
+
+bool BlockEntityMap::erase(uint32_t key)
+{
+	if(entities.empty())
+		return false;
+
+	size_t slot = findSlot(key);
+	if(table[slot] == 0)
+		return false;
+
+	//Shift the entities after the slot back into it, so
+	//no probe sequence is broken by the empty slot
+	size_t index = table[slot] - 1;
+	size_t mask = table.size() - 1;
+	table[slot] = 0;
+	for(size_t i = (slot + 1) & mask; table[i] != 0; i = (i + 1) & mask)
+	{
+		size_t home = hashKey(entities[table[i] - 1].key) & mask;
+		//The entry can move to the empty slot if its home is not between the two
+		if(((i - home) & mask) >= ((i - slot) & mask))
+		{
+			table[slot] = table[i];
+			table[i] = 0;
+			slot = i;
+		}
+	}
+
+	//Move the last entity into the hole so the array stays packed
+	garbageBytes += entities[index].size;
+	if(index != entities.size() - 1)
+	{
+		table[findSlot(entities.back().key)] = uint32_t(index + 1);
+		entities[index] = entities.back();
+	}
+	entities.pop_back();
+
+	if(entities.empty())
+		clear();
+	else if(garbageBytes * 2 > payloads.size())
+		compactPayloads();
+	return true;
+}
+
+void BlockEntityMap::clear()
+{
+	entities.clear();
+	entities.shrink_to_fit();
+	payloads.clear();
+	payloads.shrink_to_fit();
+	table.clear();
+	table.shrink_to_fit();
+	garbageBytes = 0;
+}
+
+size_t BlockEntityMap::memoryUsage() const
+{
+	return entities.capacity() * sizeof(BlockEntity) +
+		   payloads.capacity() +
+		   table.capacity() * sizeof(uint32_t);
+}
+
+size_t BlockEntityMap::serializedSize() const
+{
+	return sizeof(uint32_t) + entities.size() * ENTITY_HEADER_BYTES + payloads.size() - garbageBytes;
+}
+
+size_t BlockEntityMap::serializedSizeAfterSet(uint32_t key, uint32_t size) const
+{
+	size_t total = serializedSize() + size;
+	if(const BlockEntity *entity = find(key))
+		return total - entity->size;
+	return total + ENTITY_HEADER_BYTES;
+}
+
+void BlockEntityMap::serialize(uint8_t *out) const
+{
+	uint32_t count = entities.size();
+	memcpy(out, &count, sizeof(count));
+	out += sizeof(count);
+
+	for(auto &entity : entities)
+	{
+		memcpy(out, &entity.key, sizeof(entity.key));
+		out += sizeof(entity.key);
+		*out++ = entity.block;
+		memcpy(out, &entity.size, sizeof(entity.size));
+		out += sizeof(entity.size);
+		memcpy(out, payloads.data() + entity.offset, entity.size);
+		out += entity.size;
+	}
+}
+
+bool BlockEntityMap::deserialize(const uint8_t *data, size_t size)
+{
+	clear();
+
+	uint32_t count;
+	if(size < sizeof(count))
+		return false;
+	memcpy(&count, data, sizeof(count));
+	size_t pos = sizeof(count);
+
+	for(uint32_t i = 0; i < count; i++)
+	{
+		if(size - pos < ENTITY_HEADER_BYTES)
+		{
+			clear();
+			return false;
+		}
+
+		uint32_t key, payloadSize;
+		memcpy(&key, data + pos, sizeof(key));
+		pos += sizeof(key);
+		uint8_t block = data[pos++];
+		memcpy(&payloadSize, data + pos, sizeof(payloadSize));
+		pos += sizeof(payloadSize);
+
+		if(size - pos < payloadSize)
+		{
+			clear();
+			return false;
+		}
+		set(key, block, data + pos, payloadSize);
+		pos += payloadSize;
+	}
+
+	return true;
+}
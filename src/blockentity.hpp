@@ -0,0 +1,84 @@
+#ifndef __BLOCKENTITY_H__
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+//Position of a block in a chunk, x and z are relative to the chunk
+inline uint32_t blockEntityKey(int32_t x, int32_t y, int32_t z)
+{
+	return (uint32_t(y) << 8) | (uint32_t(z) << 4) | uint32_t(x);
+}
+
+//Extra state for one block (the contents of a container, the text
+//of a sign...), the state is an opaque payload that is up to
+//whatever uses the block type to interpret
+struct BlockEntity
+{
+	//See blockEntityKey
+	uint32_t key;
+	//Type of the block the entity belongs to, the entity
+	//is removed when the block changes to another type
+	uint8_t block;
+	//Part of BlockEntityMap's payload array that holds the state
+	uint32_t offset, size;
+
+	int32_t x() const { return key & 0xf; }
+	int32_t y() const { return key >> 8; }
+	int32_t z() const { return (key >> 4) & 0xf; }
+};
+
+//Sparse map from positions in a chunk to block entities.
+//Most chunks have no entities, an empty map does not allocate anything
+//and nothing else about the chunk changes, so reading blocks costs the
+//same with or without entities. The entities are stored one after the
+//other in one array and their payloads in another, so going through
+//every entity of a chunk (ticking) reads memory front to back.
+//Lookups go through an open addressing table (linear probing) of
+//indices into the entity array
+class BlockEntityMap
+{
+	std::vector<BlockEntity> entities;
+	std::vector<uint8_t> payloads;
+	//Index into entities + 1, 0 for empty slots, the size is a power of two
+	std::vector<uint32_t> table;
+	//Bytes of payloads that belong to removed or replaced entities
+	size_t garbageBytes = 0;
+
+	//Returns the slot of the key, or the empty slot where it would go
+	size_t findSlot(uint32_t key) const;
+	void rehash(size_t capacity);
+	//Rebuilds payloads without the garbage, in entity order
+	void compactPayloads();
+public:
+	bool empty() const;
+	size_t size() const;
+	//Returns nullptr if there is no entity at the position
+	const BlockEntity* find(uint32_t key) const;
+	//Entities in storage order, valid until the map is changed
+	const std::vector<BlockEntity>& all() const;
+	//Payload of an entity, valid until the map is changed
+	uint8_t* payload(const BlockEntity &entity);
+	const uint8_t* payload(const BlockEntity &entity) const;
+	//Adds an entity or replaces the one that is already at the position
+	void set(uint32_t key, uint8_t block, const uint8_t *data, uint32_t size);
+	//Returns false if there was no entity at the position
+	bool erase(uint32_t key);
+	void clear();
+	size_t memoryUsage() const;
+
+	//Number of bytes serialize writes
+	size_t serializedSize() const;
+	//Number of bytes serialize would write after set(key, ..., size)
+	size_t serializedSizeAfterSet(uint32_t key, uint32_t size) const;
+	//Writes the number of entities, then the key, block,
+	//payload size and payload of each entity, in native
+	//byte order like the rest of the world file
+	void serialize(uint8_t *out) const;
+	//Replaces the entities with the ones in data,
+	//returns false and leaves the map empty if data is not valid
+	bool deserialize(const uint8_t *data, size_t size);
+};
+
+#endif
+
+#define __BLOCKENTITY_H__
@@ -0,0 +1,81 @@
+#include "blockquery.hpp"
+#include "chunk.hpp"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static_assert(CHUNK_SIZE == 16, "matchRow compares a row as one 16 byte vector");
+
+//Palettes up to this size are counted with one vectorized pass
+//per palette entry, bigger ones are counted one block at a time
+const size_t MAX_VECTOR_PALETTE = 16;
+
+uint32_t SectionBox::volume() const
+{
+	return uint32_t(maxX - minX + 1) * uint32_t(maxY - minY + 1) * uint32_t(maxZ - minZ + 1);
+}
+
+uint32_t matchRow(const uint8_t *row, uint8_t block)
+{
+#ifdef __SSE2__
+	__m128i blocks = _mm_loadu_si128((const __m128i*)row);
+	return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(blocks, _mm_set1_epi8(char(block)))));
+#else
+	uint32_t mask = 0;
+	for(int32_t x = 0; x < CHUNK_SIZE; x++)
+		if(row[x] == block)
+			mask |= 1u << x;
+	return mask;
+#endif
+}
+
+//Selects bits minX -> maxX of a row mask
+static uint32_t rowMask(const SectionBox &box)
+{
+	return ((2u << box.maxX) - 1) & ~((1u << box.minX) - 1);
+}
+
+uint32_t countInSection(const uint8_t *blocks, const SectionBox &box, uint8_t block)
+{
+	uint32_t mask = rowMask(box);
+	uint32_t count = 0;
+	for(int32_t y = box.minY; y <= box.maxY; y++)
+		for(int32_t z = box.minZ; z <= box.maxZ; z++)
+			count += __builtin_popcount(matchRow(&blocks[chunkBlockIndex(0, y, z)], block) & mask);
+	return count;
+}
+
+void findInSection(const uint8_t *blocks, const SectionBox &box, uint8_t block,
+				   glm::ivec3 sectionPos, std::vector<glm::ivec3> &out)
+{
+	uint32_t mask = rowMask(box);
+	for(int32_t y = box.minY; y <= box.maxY; y++)
+	{
+		for(int32_t z = box.minZ; z <= box.maxZ; z++)
+		{
+			uint32_t matches = matchRow(&blocks[chunkBlockIndex(0, y, z)], block) & mask;
+			while(matches)
+			{
+				int32_t x = __builtin_ctz(matches);
+				matches &= matches - 1;
+				out.push_back(sectionPos + glm::ivec3(x, y, z));
+			}
+		}
+	}
+}
+
+void addSectionHistogram(const uint8_t *blocks, const SectionBox &box,
+						 const std::vector<uint8_t> &palette, BlockHistogram &histogram)
+{
+	if(palette.size() <= MAX_VECTOR_PALETTE)
+	{
+		for(auto block : palette)
+			histogram[block] += countInSection(blocks, box, block);
+		return;
+	}
+
+	for(int32_t y = box.minY; y <= box.maxY; y++)
+		for(int32_t z = box.minZ; z <= box.maxZ; z++)
+			for(int32_t x = box.minX; x <= box.maxX; x++)
+				histogram[blocks[chunkBlockIndex(x, y, z)]]++;
+}
@@ -0,0 +1,39 @@
+#ifndef __BLOCKQUERY_H__
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <vector>
+#include <glm/glm.hpp>
+
+//Number of blocks of each type, indexed by block id
+typedef std::array<uint64_t, 256> BlockHistogram;
+
+//Part of a section (inclusive, relative to the section)
+struct SectionBox
+{
+	int32_t minX, minY, minZ;
+	int32_t maxX, maxY, maxZ;
+
+	uint32_t volume() const;
+};
+
+//Kernels that the region queries in World run on each section,
+//blocks is a decoded section (SECTION_VOLUME bytes indexed with
+//chunkBlockIndex). Every row along x is compared with one SSE2
+//instruction where it is available
+
+//Returns a mask with bit x set if row[x] == block (CHUNK_SIZE bytes)
+uint32_t matchRow(const uint8_t *row, uint8_t block);
+uint32_t countInSection(const uint8_t *blocks, const SectionBox &box, uint8_t block);
+//Adds the world position of every matching block to out,
+//sectionPos is the world position of the section's corner
+void findInSection(const uint8_t *blocks, const SectionBox &box, uint8_t block,
+				   glm::ivec3 sectionPos, std::vector<glm::ivec3> &out);
+//Adds every block in the box to the histogram, palette
+//holds every block type that can be in the section
+void addSectionHistogram(const uint8_t *blocks, const SectionBox &box,
+						 const std::vector<uint8_t> &palette, BlockHistogram &histogram);
+
+#endif
+
+#define __BLOCKQUERY_H__
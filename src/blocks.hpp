@@ -0,0 +1,132 @@
+#ifndef __BLOCKS_H__
+#include <stdint.h>
+
+enum Blocks : uint8_t
+{
+	AIR,
+	GRASS,
+	DIRT,
+	STONE,
+	BRICK,
+	WOOD,
+	BARK,
+	LOG,
+	LEAVES
+};
+
+const int32_t TEXTURE_ATLAS_SIZE = 16;
+
+//Right = +x, Left = -x, Top = +y, Bottom = -y, Front = +z, Back = -z
+enum BlockFace
+{
+	RIGHT_FACE,
+	LEFT_FACE,
+	TOP_FACE,
+	BOTTOM_FACE,
+	FRONT_FACE,
+	BACK_FACE
+};
+
+//Description of a type of block
+struct BlockType
+{
+	//Index into the texture atlas of each face (in BlockFace order)
+	uint8_t textures[6];
+	//Hides the faces of the blocks next to it
+	bool opaque;
+	//Collides with the player and stops raycasts
+	bool solid;
+	//Drawn, but the texture has see through parts, so the faces
+	//of the blocks behind it are drawn as well. Blocks that are
+	//neither opaque nor transparent (air) are not drawn
+	bool transparent;
+};
+
+//Block with the same texture on every face
+constexpr BlockType simpleBlock(uint8_t texture)
+{
+	return { { texture, texture, texture, texture, texture, texture }, true, true, false };
+}
+
+//Every block type, indexed by block id
+constexpr BlockType BLOCK_TYPES[] = {
+	//Air
+	{ { 0, 0, 0, 0, 0, 0 }, false, false, false },
+	//Grass
+	{ 
+		{ 
+			GRASS + TEXTURE_ATLAS_SIZE, GRASS + TEXTURE_ATLAS_SIZE,
+			GRASS, DIRT,
+			GRASS + TEXTURE_ATLAS_SIZE, GRASS + TEXTURE_ATLAS_SIZE
+		}, 
+		true, true, false 
+	},
+	simpleBlock(DIRT),
+	simpleBlock(STONE),
+	simpleBlock(BRICK),
+	simpleBlock(WOOD),
+	simpleBlock(BARK),
+	//Log
+	{ { BARK, BARK, LOG, LOG, BARK, BARK }, true, true, false },
+	//Leaves
+	{ { LEAVES, LEAVES, LEAVES, LEAVES, LEAVES, LEAVES }, false, true, true },
+};
+
+const uint32_t BLOCK_TYPE_COUNT = sizeof(BLOCK_TYPES) / sizeof(BLOCK_TYPES[0]);
+
+//BLOCK_TYPES flattened into one array per property so
+//that each lookup is a single load indexed by block id,
+//ids that are not in BLOCK_TYPES act like simpleBlock(id)
+struct BlockTables
+{
+	uint8_t textures[6][256];
+	bool opaque[256];
+	bool solid[256];
+	bool transparent[256];
+};
+
+constexpr BlockTables flattenBlockTypes()
+{
+	BlockTables tables = {};
+	for(uint32_t id = 0; id < 256; id++)
+	{
+		BlockType type = id < BLOCK_TYPE_COUNT ? BLOCK_TYPES[id] : simpleBlock(id);
+		for(int face = 0; face < 6; face++)
+			tables.textures[face][id] = type.textures[face];
+		tables.opaque[id] = type.opaque;
+		tables.solid[id] = type.solid;
+		tables.transparent[id] = type.transparent;
+	}
+	return tables;
+}
+
+inline constexpr BlockTables BLOCK_TABLES = flattenBlockTypes();
+
+inline bool isOpaqueBlock(uint8_t block)
+{
+	return BLOCK_TABLES.opaque[block];
+}
+
+inline bool isSolidBlock(uint8_t block)
+{
+	return BLOCK_TABLES.solid[block];
+}
+
+inline bool isTransparentBlock(uint8_t block)
+{
+	return BLOCK_TABLES.transparent[block];
+}
+
+inline bool isDrawnBlock(uint8_t block)
+{
+	return BLOCK_TABLES.opaque[block] || BLOCK_TABLES.transparent[block];
+}
+
+inline uint8_t blockTexture(uint8_t block, BlockFace face)
+{
+	return BLOCK_TABLES.textures[face][block];
+}
+
+#endif
+
+#define __BLOCKS_H__
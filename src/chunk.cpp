@@ -0,0 +1,762 @@
+#include "chunk.hpp"
+#include "blockalloc.hpp"
+#include <string.h>
+#include <utility>
+#include <algorithm>
+
+//Returns the number of bits needed to store an index
+//into a palette with paletteSize entries
+static uint32_t bitsForPaletteSize(size_t paletteSize)
+{
+	if(paletteSize <= 1)
+		return 0;
+	else if(paletteSize <= 2)
+		return 1;
+	else if(paletteSize <= 4)
+		return 2;
+	else if(paletteSize <= 16)
+		return 4;
+	return 8;
+}
+
+void runLengthEncode(const uint8_t *blocks, size_t count, std::vector<uint8_t> &out)
+{
+	for(size_t i = 0; i < count;)
+	{
+		size_t run = 1;
+		while(run < 256 && i + run < count && blocks[i + run] == blocks[i])
+			run++;
+		out.push_back(uint8_t(run - 1));
+		out.push_back(blocks[i]);
+		i += run;
+	}
+}
+
+size_t runLengthDecodedSize(const std::vector<uint8_t> &encoded)
+{
+	size_t count = 0;
+	for(size_t i = 0; i + 1 < encoded.size(); i += 2)
+		count += size_t(encoded[i]) + 1;
+	return count;
+}
+
+void runLengthDecode(const std::vector<uint8_t> &encoded, uint8_t *out)
+{
+	for(size_t i = 0; i + 1 < encoded.size(); i += 2)
+	{
+		size_t run = size_t(encoded[i]) + 1;
+		memset(out, encoded[i + 1], run);
+		out += run;
+	}
+}
+
+ChunkSection::ChunkSection()
+{
+	//Air
+	palette.push_back(0);
+}
+
+ChunkSection::ChunkSection(uint8_t block)
+{
+	palette.push_back(block);
+}
+
+ChunkSection::ChunkSection(const ChunkSection &other)
+{
+	//Share the data until one of the sections is changed
+	palette = other.palette;
+	data = other.data;
+	bitsPerBlock = other.bitsPerBlock;
+	occupancy = other.occupancy;
+	refs = other.refs;
+	if(refs)
+		refs->fetch_add(1, std::memory_order_relaxed);
+}
+
+ChunkSection::ChunkSection(ChunkSection &&other)
+{
+	palette = std::move(other.palette);
+	data = other.data;
+	bitsPerBlock = other.bitsPerBlock;
+	occupancy = other.occupancy;
+	refs = other.refs;
+	other.data = nullptr;
+	other.bitsPerBlock = 0;
+	other.occupancy = nullptr;
+	other.refs = nullptr;
+}
+
+ChunkSection& ChunkSection::operator=(ChunkSection other)
+{
+	std::swap(palette, other.palette);
+	std::swap(data, other.data);
+	std::swap(bitsPerBlock, other.bitsPerBlock);
+	std::swap(occupancy, other.occupancy);
+	std::swap(refs, other.refs);
+	return *this;
+}
+
+ChunkSection::~ChunkSection()
+{
+	release();
+}
+
+void ChunkSection::release()
+{
+	//acq_rel so that every read made through another reference
+	//happens before the memory is freed or reused
+	if(refs && refs->fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		freeSectionData(data, SECTION_VOLUME * bitsPerBlock / 64);
+		freeSectionData(occupancy, OCCUPANCY_WORDS);
+		delete refs;
+	}
+	data = nullptr;
+	occupancy = nullptr;
+	refs = nullptr;
+}
+
+void ChunkSection::detach()
+{
+	if(!refs || refs->load(std::memory_order_acquire) == 1)
+		return;
+
+	uint32_t words = SECTION_VOLUME * bitsPerBlock / 64;
+	uint64_t *newData = allocSectionData(words),
+			 *newOccupancy = allocSectionData(OCCUPANCY_WORDS);
+	memcpy(newData, data, words * sizeof(uint64_t));
+	memcpy(newOccupancy, occupancy, OCCUPANCY_WORDS * sizeof(uint64_t));
+
+	release();
+	data = newData;
+	occupancy = newOccupancy;
+	refs = new std::atomic<uint32_t>(1);
+}
+
+void ChunkSection::allocData(uint32_t newBitsPerBlock)
+{
+	//Leave shared arrays to the other sections using them
+	if(refs && refs->load(std::memory_order_acquire) != 1)
+		release();
+
+	freeSectionData(data, SECTION_VOLUME * bitsPerBlock / 64);
+	data = nullptr;
+	bitsPerBlock = newBitsPerBlock;
+	if(bitsPerBlock > 0)
+	{
+		data = allocSectionData(SECTION_VOLUME * bitsPerBlock / 64);
+		if(!occupancy)
+			occupancy = allocSectionData(OCCUPANCY_WORDS);
+		if(!refs)
+			refs = new std::atomic<uint32_t>(1);
+	}
+	else
+	{
+		release();
+	}
+}
+
+void ChunkSection::rebuildOccupancy()
+{
+	if(!occupancy)
+		return;
+
+	for(uint32_t word = 0; word < OCCUPANCY_WORDS; word++)
+	{
+		uint64_t mask = 0;
+		for(uint32_t bit = 0; bit < 64; bit++)
+			if(isOpaqueBlock(palette[getIndex(SectionLayout::fromLinear(word * 64 + bit))]))
+				mask |= uint64_t(1) << bit;
+		occupancy[word] = mask;
+	}
+}
+
+uint32_t ChunkSection::getIndex(uint32_t i) const
+{
+	if(bitsPerBlock == 0)
+		return 0;
+
+	//bitsPerBlock is always a power of 2 that is at most 8
+	//so an index never crosses over into the next word
+	uint32_t bit = i * bitsPerBlock;
+	uint64_t mask = (uint64_t(1) << bitsPerBlock) - 1;
+	return uint32_t((data[bit / 64] >> (bit % 64)) & mask);
+}
+
+void ChunkSection::setIndex(uint32_t i, uint32_t paletteIndex)
+{
+	if(bitsPerBlock == 0)
+		return;
+
+	uint32_t bit = i * bitsPerBlock;
+	uint64_t mask = (uint64_t(1) << bitsPerBlock) - 1;
+	data[bit / 64] &= ~(mask << (bit % 64));
+	data[bit / 64] |= (uint64_t(paletteIndex) & mask) << (bit % 64);
+}
+
+void ChunkSection::grow(uint32_t newBitsPerBlock)
+{
+	std::vector<uint32_t> indices(SECTION_VOLUME);
+	for(uint32_t i = 0; i < SECTION_VOLUME; i++)
+		indices[i] = getIndex(i);
+
+	allocData(newBitsPerBlock);
+	for(uint32_t i = 0; i < SECTION_VOLUME; i++)
+		setIndex(i, indices[i]);
+	rebuildOccupancy();
+}
+
+uint8_t ChunkSection::getBlock(int32_t x, int32_t y, int32_t z) const
+{
+	return palette[getIndex(SectionLayout::index(x, y, z))];
+}
+
+void ChunkSection::setBlock(int32_t x, int32_t y, int32_t z, uint8_t block)
+{
+	detach();
+
+	uint32_t paletteIndex = 0;
+	while(paletteIndex < palette.size() && palette[paletteIndex] != block)
+		paletteIndex++;
+
+	//Block type is not in the palette yet, add it
+	if(paletteIndex == palette.size())
+	{
+		palette.push_back(block);
+		if(palette.size() > (size_t(1) << bitsPerBlock))
+			grow(bitsForPaletteSize(palette.size()));
+	}
+
+	setIndex(SectionLayout::index(x, y, z), paletteIndex);
+
+	uint32_t i = chunkBlockIndex(x, y, z);
+	if(occupancy)
+	{
+		if(isOpaqueBlock(block))
+			occupancy[i / 64] |= uint64_t(1) << (i % 64);
+		else
+			occupancy[i / 64] &= ~(uint64_t(1) << (i % 64));
+	}
+}
+
+void ChunkSection::getBlocks(uint8_t *out) const
+{
+	if(bitsPerBlock == 0)
+	{
+		memset(out, palette[0], SECTION_VOLUME);
+		return;
+	}
+
+	uint32_t blocksPerWord = 64 / bitsPerBlock;
+	uint64_t mask = (uint64_t(1) << bitsPerBlock) - 1;
+	for(uint32_t i = 0; i < SECTION_VOLUME / blocksPerWord; i++)
+	{
+		uint64_t word = data[i];
+		for(uint32_t j = 0; j < blocksPerWord; j++)
+		{
+			out[SectionLayout::toLinear(i * blocksPerWord + j)] = palette[word & mask];
+			word >>= bitsPerBlock;
+		}
+	}
+}
+
+void ChunkSection::setBlocks(const uint8_t *blocks)
+{
+	//Position of each block type in the new palette, 0 if it is not in it
+	uint32_t paletteIndices[256] = {};
+	std::vector<uint8_t> newPalette;
+	for(uint32_t i = 0; i < SECTION_VOLUME; i++)
+	{
+		if(paletteIndices[blocks[i]] != 0)
+			continue;
+		newPalette.push_back(blocks[i]);
+		paletteIndices[blocks[i]] = newPalette.size();
+	}
+
+	palette = newPalette;
+	allocData(bitsForPaletteSize(palette.size()));
+	if(!data)
+		return;
+
+	for(uint32_t i = 0; i < SECTION_VOLUME; i++)
+		setIndex(SectionLayout::fromLinear(i), paletteIndices[blocks[i]] - 1);
+
+	for(uint32_t word = 0; word < OCCUPANCY_WORDS; word++)
+	{
+		uint64_t mask = 0;
+		for(uint32_t bit = 0; bit < 64; bit++)
+			if(isOpaqueBlock(blocks[word * 64 + bit]))
+				mask |= uint64_t(1) << bit;
+		occupancy[word] = mask;
+	}
+}
+
+bool ChunkSection::isUniform() const
+{
+	return bitsPerBlock == 0;
+}
+
+uint8_t ChunkSection::uniformBlock() const
+{
+	return palette[0];
+}
+
+bool ChunkSection::mayContain(uint8_t block) const
+{
+	for(auto paletteBlock : palette)
+		if(paletteBlock == block)
+			return true;
+	return false;
+}
+
+const std::vector<uint8_t>& ChunkSection::getPalette() const
+{
+	return palette;
+}
+
+uint64_t ChunkSection::getOccupancy(uint32_t word) const
+{
+	if(occupancy)
+		return occupancy[word];
+	return isOpaqueBlock(palette[0]) ? ~uint64_t(0) : 0;
+}
+
+uint64_t ChunkSection::getDrawn(uint32_t word) const
+{
+	if(!data)
+		return isDrawnBlock(palette[0]) ? ~uint64_t(0) : 0;
+
+	uint64_t mask = 0;
+	for(uint32_t bit = 0; bit < 64; bit++)
+		if(isDrawnBlock(palette[getIndex(SectionLayout::fromLinear(word * 64 + bit))]))
+			mask |= uint64_t(1) << bit;
+	return mask;
+}
+
+bool ChunkSection::mayContainTransparent() const
+{
+	for(uint8_t block : palette)
+		if(isTransparentBlock(block))
+			return true;
+	return false;
+}
+
+bool ChunkSection::isOpaque(int32_t x, int32_t y, int32_t z) const
+{
+	uint32_t i = chunkBlockIndex(x, y, z);
+	return (getOccupancy(i / 64) >> (i % 64)) & 1;
+}
+
+void ChunkSection::compact()
+{
+	if(bitsPerBlock == 0)
+		return;
+
+	std::vector<uint32_t> indices(SECTION_VOLUME);
+	std::vector<bool> used(palette.size(), false);
+	for(uint32_t i = 0; i < SECTION_VOLUME; i++)
+	{
+		indices[i] = getIndex(i);
+		used[indices[i]] = true;
+	}
+
+	//Map old palette indices to new ones
+	std::vector<uint8_t> newPalette;
+	std::vector<uint32_t> remap(palette.size(), 0);
+	for(uint32_t i = 0; i < palette.size(); i++)
+	{
+		if(!used[i])
+			continue;
+		remap[i] = newPalette.size();
+		newPalette.push_back(palette[i]);
+	}
+
+	palette = newPalette;
+	palette.shrink_to_fit();
+	allocData(bitsForPaletteSize(palette.size()));
+	for(uint32_t i = 0; i < SECTION_VOLUME; i++)
+		setIndex(i, remap[indices[i]]);
+	rebuildOccupancy();
+}
+
+const void* ChunkSection::dataId() const
+{
+	return data;
+}
+
+uint32_t ChunkSection::shareCount() const
+{
+	return refs ? refs->load(std::memory_order_relaxed) : 0;
+}
+
+size_t ChunkSection::dataBytes() const
+{
+	return SECTION_VOLUME * bitsPerBlock / 8 +
+		   (occupancy ? OCCUPANCY_WORDS * sizeof(uint64_t) : 0) +
+		   (refs ? sizeof(*refs) : 0);
+}
+
+size_t ChunkSection::memoryUsage() const
+{
+	return palette.capacity() * sizeof(uint8_t) + 
+		   dataBytes() / std::max(shareCount(), 1u) +
+		   sizeof(ChunkSection);
+}
+
+const ChunkSection AIR_SECTION;
+
+Chunk::Chunk(int32_t x, int32_t z)
+{
+	chunkX = x;
+	chunkZ = z;
+	for(int32_t i = 0; i < CHUNK_SIZE * CHUNK_SIZE; i++)
+		heightmap[i] = -1;
+}
+
+Chunk* Chunk::neighbor(int32_t dx, int32_t dz) const
+{
+	return neighbors[(dz + 1) * 3 + (dx + 1)].load(std::memory_order_acquire);
+}
+
+Chunk* Chunk::chunkAt(int32_t &x, int32_t &z) const
+{
+	int32_t dx = x < 0 ? -1 : (x >= CHUNK_SIZE ? 1 : 0),
+			dz = z < 0 ? -1 : (z >= CHUNK_SIZE ? 1 : 0);
+	x -= dx * CHUNK_SIZE;
+	z -= dz * CHUNK_SIZE;
+	return neighbor(dx, dz);
+}
+
+uint8_t Chunk::getBlock(int32_t x, int32_t y, int32_t z) const
+{
+	return getSection(y / CHUNK_SIZE).getBlock(x, y % CHUNK_SIZE, z);
+}
+
+void Chunk::setBlock(int32_t x, int32_t y, int32_t z, uint8_t block)
+{
+	//Air above the top of the chunk is already air
+	if(block == 0 && y / CHUNK_SIZE >= (int32_t)sections.size())
+		return;
+
+	version++;
+	addSectionsUpTo(y / CHUNK_SIZE);
+	sections[y / CHUNK_SIZE].setBlock(x, y % CHUNK_SIZE, z, block);
+
+	if(!blockEntities.empty())
+	{
+		const BlockEntity *entity = blockEntities.find(blockEntityKey(x, y, z));
+		if(entity && entity->block != block)
+			blockEntities.erase(entity->key);
+	}
+
+	int16_t &height = heightmap[z * CHUNK_SIZE + x];
+	//Air
+	if(block != 0 && y > height)
+		height = y;
+	//The top block was removed, scan down for the next block
+	else if(block == 0 && y == height)
+		recalculateHeight(x, z);
+}
+
+const ChunkSection& Chunk::getSection(int32_t sectionY) const
+{
+	if(sectionY >= (int32_t)sections.size())
+		return AIR_SECTION;
+	return sections[sectionY];
+}
+
+void Chunk::addSectionsUpTo(int32_t sectionY)
+{
+	if(sectionY >= (int32_t)sections.size())
+		sections.resize(sectionY + 1);
+}
+
+void Chunk::recalculateHeight(int32_t x, int32_t z)
+{
+	int16_t &height = heightmap[z * CHUNK_SIZE + x];
+	height = sections.size() * CHUNK_SIZE - 1;
+
+	//Skip over sections that are all air
+	while(height >= 0)
+	{
+		const ChunkSection &section = sections[height / CHUNK_SIZE];
+		if(section.isUniform() && section.uniformBlock() == 0)
+			height = (height / CHUNK_SIZE) * CHUNK_SIZE - 1;
+		//Opaque blocks are never air, so only other blocks need to be decoded
+		else if(!section.isOpaque(x, height % CHUNK_SIZE, z) && 
+				section.getBlock(x, height % CHUNK_SIZE, z) == 0)
+			height--;
+		else
+			break;
+	}
+}
+
+void Chunk::fill(int32_t minX, int32_t minY, int32_t minZ,
+				 int32_t maxX, int32_t maxY, int32_t maxZ,
+				 uint8_t block)
+{
+	//Air
+	if(block == 0)
+		maxY = std::min(maxY, (int32_t)sections.size() * CHUNK_SIZE - 1);
+	else
+		addSectionsUpTo(maxY / CHUNK_SIZE);
+	//Air above the top of the chunk is already air
+	if(maxY < minY)
+		return;
+	version++;
+
+	for(int32_t sectionY = minY / CHUNK_SIZE; sectionY <= maxY / CHUNK_SIZE; sectionY++)
+	{
+		int32_t bottom = std::max(minY - sectionY * CHUNK_SIZE, 0),
+				top = std::min(maxY - sectionY * CHUNK_SIZE, CHUNK_SIZE - 1);
+
+		//The whole section is inside of the box
+		if(minX == 0 && minZ == 0 && maxX == CHUNK_SIZE - 1 && maxZ == CHUNK_SIZE - 1 &&
+		   bottom == 0 && top == CHUNK_SIZE - 1)
+		{
+			sections[sectionY] = ChunkSection(block);
+			continue;
+		}
+
+		ChunkSection &section = sections[sectionY];
+		for(int32_t y = bottom; y <= top; y++)
+			for(int32_t z = minZ; z <= maxZ; z++)
+				for(int32_t x = minX; x <= maxX; x++)
+					section.setBlock(x, y, z, block);
+		section.compact();
+	}
+
+	for(int32_t z = minZ; z <= maxZ; z++)
+		for(int32_t x = minX; x <= maxX; x++)
+			recalculateHeight(x, z);
+	pruneBlockEntities();
+}
+
+void Chunk::replace(int32_t minX, int32_t minY, int32_t minZ,
+					int32_t maxX, int32_t maxY, int32_t maxZ,
+					uint8_t from, uint8_t to)
+{
+	bool changed = false;
+	//Air above the top of the chunk is only there if it is replaced
+	if(from == 0 && to != 0)
+		addSectionsUpTo(maxY / CHUNK_SIZE);
+	else
+		maxY = std::min(maxY, (int32_t)sections.size() * CHUNK_SIZE - 1);
+	//There are no `from` blocks above the top of the chunk
+	if(maxY < minY)
+		return;
+
+	for(int32_t sectionY = minY / CHUNK_SIZE; sectionY <= maxY / CHUNK_SIZE; sectionY++)
+	{
+		ChunkSection &section = sections[sectionY];
+		if(!section.mayContain(from))
+			continue;
+
+		changed = true;
+		int32_t bottom = std::max(minY - sectionY * CHUNK_SIZE, 0),
+				top = std::min(maxY - sectionY * CHUNK_SIZE, CHUNK_SIZE - 1);
+
+		//The whole section is inside of the box and is only `from` blocks
+		if(section.isUniform() &&
+		   minX == 0 && minZ == 0 && maxX == CHUNK_SIZE - 1 && maxZ == CHUNK_SIZE - 1 &&
+		   bottom == 0 && top == CHUNK_SIZE - 1)
+		{
+			section = ChunkSection(to);
+			continue;
+		}
+
+		for(int32_t y = bottom; y <= top; y++)
+			for(int32_t z = minZ; z <= maxZ; z++)
+				for(int32_t x = minX; x <= maxX; x++)
+					if(section.getBlock(x, y, z) == from)
+						section.setBlock(x, y, z, to);
+		section.compact();
+	}
+
+	if(!changed)
+		return;
+
+	version++;
+
+	for(int32_t z = minZ; z <= maxZ; z++)
+		for(int32_t x = minX; x <= maxX; x++)
+			recalculateHeight(x, z);
+	pruneBlockEntities();
+}
+
+int32_t Chunk::getHeight(int32_t x, int32_t z) const
+{
+	return heightmap[z * CHUNK_SIZE + x];
+}
+
+void Chunk::getBlocks(uint8_t *out) const
+{
+	for(size_t i = 0; i < sections.size(); i++)
+		sections[i].getBlocks(out + i * SECTION_VOLUME);
+}
+
+void Chunk::setBlocks(const uint8_t *blocks, size_t sectionCount)
+{
+	version++;
+	//Leave out the air at the top, the top sections
+	//can have been dug out after they were saved
+	while(sectionCount > 0)
+	{
+		const uint8_t *top = blocks + (sectionCount - 1) * SECTION_VOLUME;
+		//Air
+		if(std::any_of(top, top + SECTION_VOLUME, [](uint8_t block) { return block != 0; }))
+			break;
+		sectionCount--;
+	}
+
+	sections = std::vector<ChunkSection>(sectionCount);
+	for(size_t i = 0; i < sections.size(); i++)
+		sections[i].setBlocks(blocks + i * SECTION_VOLUME);
+
+	for(int32_t i = 0; i < CHUNK_SIZE * CHUNK_SIZE; i++)
+		heightmap[i] = -1;
+	//Blocks are in y order, so the last block that
+	//is not air in a column is the highest one
+	for(int32_t y = 0; y < (int32_t)sections.size() * CHUNK_SIZE; y++)
+	{
+		const uint8_t *layer = blocks + y * CHUNK_SIZE * CHUNK_SIZE;
+		for(int32_t i = 0; i < CHUNK_SIZE * CHUNK_SIZE; i++)
+			//Air
+			if(layer[i] != 0)
+				heightmap[i] = y;
+	}
+	pruneBlockEntities();
+}
+
+void Chunk::setSectionBlocks(int32_t sectionY, const uint8_t *blocks)
+{
+	version++;
+	addSectionsUpTo(sectionY);
+	sections[sectionY].setBlocks(blocks);
+
+	int32_t bottom = sectionY * CHUNK_SIZE;
+	for(int32_t z = 0; z < CHUNK_SIZE; z++)
+	{
+		for(int32_t x = 0; x < CHUNK_SIZE; x++)
+		{
+			//Highest block in the column that is in the section
+			int32_t top = -1;
+			for(int32_t y = CHUNK_SIZE - 1; y >= 0 && top < 0; y--)
+				//Air
+				if(blocks[chunkBlockIndex(x, y, z)] != 0)
+					top = bottom + y;
+
+			int16_t &height = heightmap[z * CHUNK_SIZE + x];
+			if(top > height)
+				height = top;
+			//The top block of the column was in the section and is gone
+			else if(height >= bottom && height < bottom + CHUNK_SIZE && top < height)
+				recalculateHeight(x, z);
+		}
+	}
+	pruneBlockEntities();
+}
+
+int32_t Chunk::maxHeight() const
+{
+	int32_t maxHeight = -1;
+	for(int32_t i = 0; i < CHUNK_SIZE * CHUNK_SIZE; i++)
+		maxHeight = std::max(maxHeight, (int32_t)heightmap[i]);
+	return maxHeight;
+}
+
+void Chunk::pruneBlockEntities()
+{
+	//Entities can be removed while going through them, so collect them first
+	std::vector<uint32_t> removed;
+	for(const auto &entity : blockEntities.all())
+		if(getBlock(entity.x(), entity.y(), entity.z()) != entity.block)
+			removed.push_back(entity.key);
+	for(uint32_t key : removed)
+		blockEntities.erase(key);
+}
+
+std::shared_ptr<const ChunkSnapshot> Chunk::snapshot() const
+{
+	auto copy = std::make_shared<ChunkSnapshot>();
+	copy->sections = sections;
+	copy->chunkX = chunkX;
+	copy->chunkZ = chunkZ;
+	copy->version = version;
+	copy->maxHeight = maxHeight();
+	return copy;
+}
+
+uint8_t ChunkSnapshot::getBlock(int32_t x, int32_t y, int32_t z) const
+{
+	return getSection(y / CHUNK_SIZE).getBlock(x, y % CHUNK_SIZE, z);
+}
+
+const ChunkSection& ChunkSnapshot::getSection(int32_t sectionY) const
+{
+	if(sectionY >= (int32_t)sections.size())
+		return AIR_SECTION;
+	return sections[sectionY];
+}
+
+void ChunkSnapshot::getBlocks(uint8_t *out) const
+{
+	for(size_t i = 0; i < sections.size(); i++)
+		sections[i].getBlocks(out + i * SECTION_VOLUME);
+}
+
+bool Chunk::compressBlocks()
+{
+	if(cold)
+		return true;
+
+	std::vector<uint8_t> blocks(sections.size() * SECTION_VOLUME);
+	getBlocks(blocks.data());
+
+	std::vector<uint8_t> encoded;
+	runLengthEncode(blocks.data(), blocks.size(), encoded);
+	encoded.shrink_to_fit();
+
+	size_t sectionMemory = 0;
+	for(const auto &section : sections)
+		sectionMemory += section.memoryUsage();
+	if(encoded.capacity() >= sectionMemory)
+		return false;
+
+	compressedBlocks = std::move(encoded);
+	sections.clear();
+	sections.shrink_to_fit();
+	cold = true;
+	return true;
+}
+
+void Chunk::decompressBlocks()
+{
+	if(!cold)
+		return;
+
+	std::vector<uint8_t> blocks(runLengthDecodedSize(compressedBlocks));
+	runLengthDecode(compressedBlocks, blocks.data());
+
+	sections = std::vector<ChunkSection>(blocks.size() / SECTION_VOLUME);
+	for(size_t i = 0; i < sections.size(); i++)
+		sections[i].setBlocks(blocks.data() + i * SECTION_VOLUME);
+
+	compressedBlocks.clear();
+	compressedBlocks.shrink_to_fit();
+	cold = false;
+}
+
+void Chunk::compact()
+{
+	for(auto &section : sections)
+		section.compact();
+}
+
+size_t Chunk::memoryUsage() const
+{
+	size_t total = sizeof(Chunk) + compressedBlocks.capacity() + blockEntities.memoryUsage();
+	for(const auto &section : sections)
+		total += section.memoryUsage();
+	return total;
+}
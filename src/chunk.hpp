@@ -0,0 +1,366 @@
+#ifndef __CHUNK_H__
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include "blocks.hpp"
+#include "blockentity.hpp"
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+const int32_t CHUNK_SIZE = 16;
+//Number of blocks in a CHUNK_SIZE x CHUNK_SIZE x CHUNK_SIZE section
+const int32_t SECTION_VOLUME = CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+//Number of 64 bit words in a section's occupancy mask,
+//each word holds 4 rows of CHUNK_SIZE blocks along the x axis
+const int32_t OCCUPANCY_WORDS = SECTION_VOLUME / 64;
+
+//Returns the index of a block inside of a section,
+//x, y and z are relative to the section (0 -> CHUNK_SIZE - 1)
+//this is the layout used by occupancy masks, views and
+//anything else that works on rows of blocks
+inline uint32_t chunkBlockIndex(int32_t x, int32_t y, int32_t z)
+{
+	return (uint32_t)y * CHUNK_SIZE * CHUNK_SIZE + (uint32_t)z * CHUNK_SIZE + (uint32_t)x;
+}
+
+//Encodes blocks as (run length - 1, block) pairs,
+//runs are at most 256 blocks long
+void runLengthEncode(const uint8_t *blocks, size_t count, std::vector<uint8_t> &out);
+//Returns the number of blocks that runLengthDecode will write
+size_t runLengthDecodedSize(const std::vector<uint8_t> &encoded);
+void runLengthDecode(const std::vector<uint8_t> &encoded, uint8_t *out);
+
+//Layouts for the packed block data of a section, the layout
+//is picked at compile time (see SectionLayout below).
+//index() returns where a block is stored, toLinear() and
+//fromLinear() convert between that and chunkBlockIndex
+
+//Blocks are stored in the same order as chunkBlockIndex
+struct LinearLayout
+{
+	static inline uint32_t index(int32_t x, int32_t y, int32_t z)
+	{
+		return chunkBlockIndex(x, y, z);
+	}
+
+	static inline uint32_t toLinear(uint32_t i)
+	{
+		return i;
+	}
+
+	static inline uint32_t fromLinear(uint32_t i)
+	{
+		return i;
+	}
+};
+
+//Blocks are stored in Morton (Z) order, the bits of x, y and z
+//are interleaved so that blocks that are close to each other
+//in all 3 directions are close to each other in memory
+struct MortonLayout
+{
+	static const uint32_t X_MASK = 0x249;
+	static const uint32_t Y_MASK = X_MASK << 1;
+	static const uint32_t Z_MASK = X_MASK << 2;
+
+	//Moves the 4 low bits of v to bits 0, 3, 6 and 9
+	static inline uint32_t spread(uint32_t v)
+	{
+#ifdef __BMI2__
+		return _pdep_u32(v, X_MASK);
+#else
+		return (v & 1) | ((v & 2) << 2) | ((v & 4) << 4) | ((v & 8) << 6);
+#endif
+	}
+
+	//Inverse of spread
+	static inline uint32_t compact(uint32_t v)
+	{
+#ifdef __BMI2__
+		return _pext_u32(v, X_MASK);
+#else
+		return (v & 1) | ((v >> 2) & 2) | ((v >> 4) & 4) | ((v >> 6) & 8);
+#endif
+	}
+
+	static inline uint32_t index(int32_t x, int32_t y, int32_t z)
+	{
+		return spread(x) | (spread(y) << 1) | (spread(z) << 2);
+	}
+
+	static inline uint32_t toLinear(uint32_t i)
+	{
+		return chunkBlockIndex(compact(i), compact(i >> 1), compact(i >> 2));
+	}
+
+	static inline uint32_t fromLinear(uint32_t i)
+	{
+		return index(i % CHUNK_SIZE, i / (CHUNK_SIZE * CHUNK_SIZE), (i / CHUNK_SIZE) % CHUNK_SIZE);
+	}
+};
+
+//Configure with -DBLOCKGAME_MORTON_LAYOUT=ON to use Morton order
+#ifdef BLOCKGAME_MORTON_LAYOUT
+typedef MortonLayout SectionLayout;
+#else
+typedef LinearLayout SectionLayout;
+#endif
+
+//A CHUNK_SIZE x CHUNK_SIZE x CHUNK_SIZE cube of blocks,
+//each block is stored as an index into a palette of the block
+//types that appear in the section, the indices are packed
+//into 64 bit words using 1, 2, 4 or 8 bits per block depending
+//on how many different block types the section contains.
+//A section that only contains one type of block uses 0 bits
+//per block and does not allocate any index data.
+//Copies of a section share the index data and occupancy mask
+//until one of them is changed (copy on write), so copying a
+//section is cheap and a copy never sees later changes
+class ChunkSection
+{
+	std::vector<uint8_t> palette;
+	//Palette indices in SectionLayout order,
+	//SECTION_VOLUME * bitsPerBlock / 64 words, allocated with
+	//allocSectionData, nullptr if bitsPerBlock is 0
+	uint64_t *data = nullptr;
+	uint32_t bitsPerBlock = 0;
+	//One bit per block that is set if the block is opaque,
+	//bit i % 64 of word i / 64 is block i (see chunkBlockIndex),
+	//nullptr if bitsPerBlock is 0
+	uint64_t *occupancy = nullptr;
+	//Number of sections sharing data and occupancy,
+	//nullptr if bitsPerBlock is 0
+	std::atomic<uint32_t> *refs = nullptr;
+
+	//Drops this section's reference to data and occupancy,
+	//freeing them if no other section uses them
+	void release();
+	//Gives the section its own copy of data and occupancy
+	//if they are shared, call before changing either of them
+	void detach();
+	//Replaces data with a zeroed array for the new number of bits
+	void allocData(uint32_t newBitsPerBlock);
+	//Recalculates the occupancy mask from the block data
+	void rebuildOccupancy();
+	uint32_t getIndex(uint32_t i) const;
+	void setIndex(uint32_t i, uint32_t paletteIndex);
+	//Repacks the indices to use more bits per block
+	void grow(uint32_t newBitsPerBlock);
+public:
+	//Creates a section that is completely filled with air
+	ChunkSection();
+	//Creates a section that is completely filled with one type of block
+	ChunkSection(uint8_t block);
+	ChunkSection(const ChunkSection &other);
+	ChunkSection(ChunkSection &&other);
+	ChunkSection& operator=(ChunkSection other);
+	~ChunkSection();
+
+	uint8_t getBlock(int32_t x, int32_t y, int32_t z) const;
+	void setBlock(int32_t x, int32_t y, int32_t z, uint8_t block);
+	//Decodes every block in the section into out (SECTION_VOLUME bytes),
+	//out is indexed with chunkBlockIndex
+	void getBlocks(uint8_t *out) const;
+	//Replaces every block in the section with blocks (SECTION_VOLUME bytes,
+	//indexed with chunkBlockIndex), the palette is rebuilt from scratch
+	void setBlocks(const uint8_t *blocks);
+	//Returns true if every block in the section is the same type
+	bool isUniform() const;
+	//Only meaningful if the section is uniform
+	uint8_t uniformBlock() const;
+	//Returns false if the block type is definitely not in the section
+	bool mayContain(uint8_t block) const;
+	//Block types that can appear in the section,
+	//may include types that are no longer used
+	const std::vector<uint8_t>& getPalette() const;
+	//Returns word `word` of the occupancy mask,
+	//also works for uniform sections
+	uint64_t getOccupancy(uint32_t word) const;
+	//Like getOccupancy, but the bits are set for every block that is
+	//drawn (opaque or transparent, see BlockType). Has to decode the
+	//blocks, getOccupancy gives the same mask if no block in the
+	//palette is transparent
+	uint64_t getDrawn(uint32_t word) const;
+	//Returns true if a block in the palette is transparent
+	bool mayContainTransparent() const;
+	bool isOpaque(int32_t x, int32_t y, int32_t z) const;
+	//Removes block types that are no longer used from the palette
+	//and repacks the indices with as few bits as possible
+	void compact();
+	//Identifies the section's data, sections with the same
+	//id share their data, nullptr for uniform sections
+	const void* dataId() const;
+	//Number of sections sharing the data, 0 for uniform sections
+	uint32_t shareCount() const;
+	//Bytes used by the data (indices and occupancy mask)
+	size_t dataBytes() const;
+	//Returns the number of bytes of block data the section uses,
+	//shared data is split evenly between the sections sharing it
+	size_t memoryUsage() const;
+};
+
+//Section that is all air, returned for sections above the top of a chunk
+extern const ChunkSection AIR_SECTION;
+
+//A copy of a section along with a one block border (halo)
+//taken from the sections around it, neighbors of any block
+//in the section can be read without bounds checks by adding
+//the strides to the block's index
+struct BlockView
+{
+	static const int32_t SIZE = CHUNK_SIZE + 2;
+	static const int32_t STRIDE_X = 1;
+	static const int32_t STRIDE_Z = SIZE;
+	static const int32_t STRIDE_Y = SIZE * SIZE;
+
+	uint8_t blocks[SIZE * SIZE * SIZE];
+
+	//x, y and z range from -1 to CHUNK_SIZE
+	static inline int32_t index(int32_t x, int32_t y, int32_t z)
+	{
+		return (y + 1) * STRIDE_Y + (z + 1) * STRIDE_Z + (x + 1) * STRIDE_X;
+	}
+};
+
+//An immutable copy of a chunk's blocks, taken with Chunk::snapshot.
+//The sections share their data with the chunk, so taking a snapshot
+//only copies the palettes and a later edit to the chunk only copies
+//the sections that it changes. Snapshots can be read from any thread
+struct ChunkSnapshot
+{
+	//Same as Chunk::sections
+	std::vector<ChunkSection> sections;
+	int32_t chunkX = 0, chunkZ = 0;
+	//Version of the chunk when the snapshot was taken
+	uint64_t version = 0;
+	//Highest value in the chunk's heightmap
+	int32_t maxHeight = -1;
+
+	//x and z are relative to the chunk, y has to be in the world
+	uint8_t getBlock(int32_t x, int32_t y, int32_t z) const;
+	//Same layout as Chunk::getBlocks
+	void getBlocks(uint8_t *out) const;
+	//Returns AIR_SECTION above the top of the chunk
+	const ChunkSection& getSection(int32_t sectionY) const;
+};
+
+//Mesh of one section of a chunk, every section is
+//meshed, uploaded, culled and drawn on its own
+struct SectionMesh
+{
+	//OpenGL objects, these are only created once
+	//the section has something to draw
+	unsigned int vao = 0;
+	unsigned int buffers[2] = { 0, 0 };
+	unsigned int vertexCount = 0;
+	//World edit version (see World::markDirty) when the snapshots
+	//for the mesh were taken, older meshes are thrown away
+	uint64_t meshVersion = 0;
+};
+
+//A column of sections, the column only goes up as high as its
+//highest section that is not all air, everything above that is air
+//and sections are added when blocks are placed there. So a tall
+//world only stores the sky above a chunk once something is built in it
+struct Chunk
+{
+	//Indexed by section y, from the bottom of the world up
+	std::vector<ChunkSection> sections;
+	//y value of the highest block that is not air in each column,
+	//-1 if the column is empty, indexed z * CHUNK_SIZE + x
+	int16_t heightmap[CHUNK_SIZE * CHUNK_SIZE];
+	int32_t chunkX = 0, chunkZ = 0;
+	//Set once trees have been added to the chunk
+	bool decorated = false;
+	//Set once the chunk is stored in the world file
+	bool saved = false;
+	//Increased every time a block in the chunk changes
+	uint64_t version = 0;
+	//Set while the blocks are compressed (see compressBlocks),
+	//sections is empty while the chunk is cold
+	bool cold = false;
+	//Run length encoded blocks of a cold chunk
+	std::vector<uint8_t> compressedBlocks;
+	//Last time the blocks of the chunk were used (see World::getChunk),
+	//readers holding the chunk's lock shared update it as well
+	std::atomic<double> lastAccess = 0.0;
+	//The chunk and the 8 chunks around it, indexed (dz + 1) * 3 + (dx + 1),
+	//nullptr where there is no chunk yet. Kept up to date by ChunkMap as
+	//chunks are added, chunks are never removed so a neighbor stays valid
+	//once it is set and can be followed without looking the chunk up
+	std::atomic<Chunk*> neighbors[9];
+	//Extra state of blocks in the chunk, keyed with blockEntityKey,
+	//an entity is dropped when its block changes to another type
+	BlockEntityMap blockEntities;
+
+	//Indexed by section y, only used by the thread that owns the
+	//OpenGL context, may be shorter or longer than sections
+	std::vector<SectionMesh> meshes;
+
+	Chunk() = default;
+	//Creates an empty chunk with no sections
+	Chunk(int32_t x, int32_t z);
+	//dx and dz range from -1 to 1, returns nullptr if the chunk does not exist
+	Chunk* neighbor(int32_t dx, int32_t dz) const;
+	//Returns the chunk that a block is in, x and z are relative to this
+	//chunk and can be up to CHUNK_SIZE outside of it, they are changed to
+	//be relative to the returned chunk. Returns nullptr if it does not exist
+	Chunk* chunkAt(int32_t &x, int32_t &z) const;
+	//x and z are relative to the chunk, y has to be at least 0
+	uint8_t getBlock(int32_t x, int32_t y, int32_t z) const;
+	//Also keeps the heightmap up to date
+	void setBlock(int32_t x, int32_t y, int32_t z, uint8_t block);
+	//Returns AIR_SECTION above the top of the chunk
+	const ChunkSection& getSection(int32_t sectionY) const;
+	//Adds air sections until the chunk reaches sectionY
+	void addSectionsUpTo(int32_t sectionY);
+	int32_t getHeight(int32_t x, int32_t z) const;
+	//Rescans a column for its highest block
+	void recalculateHeight(int32_t x, int32_t z);
+	//Sets every block in a box (inclusive, relative to the chunk),
+	//sections that are entirely inside of the box are replaced
+	//instead of being written block by block
+	void fill(int32_t minX, int32_t minY, int32_t minZ,
+			  int32_t maxX, int32_t maxY, int32_t maxZ,
+			  uint8_t block);
+	//Replaces every `from` block in a box (inclusive, relative to the chunk)
+	//with `to`, sections that do not contain `from` are skipped
+	void replace(int32_t minX, int32_t minY, int32_t minZ,
+				 int32_t maxX, int32_t maxY, int32_t maxZ,
+				 uint8_t from, uint8_t to);
+	//Copies every block in the chunk to out, one byte per block,
+	//section by section from the bottom up with each section
+	//indexed with chunkBlockIndex (sections.size() sections)
+	void getBlocks(uint8_t *out) const;
+	//Inverse of getBlocks for sectionCount sections, sections at the
+	//top that are all air are left out, also rebuilds the heightmap
+	void setBlocks(const uint8_t *blocks, size_t sectionCount);
+	//Replaces every block in one section (SECTION_VOLUME bytes,
+	//indexed with chunkBlockIndex), adding the section if the
+	//chunk does not reach it, also keeps the heightmap up to date
+	void setSectionBlocks(int32_t sectionY, const uint8_t *blocks);
+	//Returns the highest value in the heightmap
+	int32_t maxHeight() const;
+	//Removes block entities whose block has changed to another type
+	void pruneBlockEntities();
+	//Replaces the sections with a run length encoded copy of the
+	//blocks, returns false and leaves the chunk as it is if that
+	//would not use less memory than the sections do.
+	//The heightmap is kept so it can be read while the chunk is cold
+	bool compressBlocks();
+	//Rebuilds the sections of a cold chunk
+	void decompressBlocks();
+	//Pins the current blocks of the chunk so that they can be read
+	//while the chunk is being changed, nothing may change the
+	//chunk while this runs (see World's chunk locks)
+	std::shared_ptr<const ChunkSnapshot> snapshot() const;
+	void compact();
+	size_t memoryUsage() const;
+};
+
+#endif
+
+#define __CHUNK_H__
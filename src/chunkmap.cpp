@@ -0,0 +1,105 @@
+#include "chunkmap.hpp"
+
+//Start with room for 1024 chunks
+const uint32_t INITIAL_CAPACITY_BITS = 10;
+
+static uint64_t chunkKey(int32_t chunkX, int32_t chunkZ)
+{
+	return (uint64_t(uint32_t(chunkX)) << 32) | uint64_t(uint32_t(chunkZ));
+}
+
+ChunkMap::ChunkMap()
+{
+	capacityBits = INITIAL_CAPACITY_BITS;
+	entries = std::vector<Entry>(size_t(1) << capacityBits);
+}
+
+size_t ChunkMap::slot(uint64_t key) const
+{
+	//Fibonacci hashing, the top bits of the product are well mixed
+	return size_t((key * 0x9e3779b97f4a7c15ull) >> (64 - capacityBits));
+}
+
+void ChunkMap::grow()
+{
+	std::vector<Entry> oldEntries = std::move(entries);
+	capacityBits++;
+	entries = std::vector<Entry>(size_t(1) << capacityBits);
+
+	size_t mask = entries.size() - 1;
+	for(auto &entry : oldEntries)
+	{
+		if(!entry.chunk)
+			continue;
+
+		size_t i = slot(entry.key);
+		while(entries[i].chunk)
+			i = (i + 1) & mask;
+		entries[i] = std::move(entry);
+	}
+}
+
+Chunk* ChunkMap::get(int32_t chunkX, int32_t chunkZ) const
+{
+	uint64_t key = chunkKey(chunkX, chunkZ);
+	size_t mask = entries.size() - 1;
+	for(size_t i = slot(key); entries[i].chunk; i = (i + 1) & mask)
+		if(entries[i].key == key)
+			return entries[i].chunk.get();
+	return nullptr;
+}
+
+Chunk* ChunkMap::insert(int32_t chunkX, int32_t chunkZ, std::unique_ptr<Chunk> chunk)
+{
+	if(Chunk *existing = get(chunkX, chunkZ))
+		return existing;
+
+	//Keep the load factor at or below 1/2 so probe sequences stay short
+	if((count + 1) * 2 > entries.size())
+		grow();
+
+	uint64_t key = chunkKey(chunkX, chunkZ);
+	size_t mask = entries.size() - 1;
+	size_t i = slot(key);
+	while(entries[i].chunk)
+		i = (i + 1) & mask;
+
+	count++;
+	entries[i].key = key;
+	entries[i].chunk = std::move(chunk);
+
+	//Chunks are filled in before they are added, the release stores
+	//make that visible to threads that follow the neighbor pointers
+	Chunk *added = entries[i].chunk.get();
+	for(int32_t dz = -1; dz <= 1; dz++)
+	{
+		for(int32_t dx = -1; dx <= 1; dx++)
+		{
+			Chunk *neighbor = (dx == 0 && dz == 0) ? added : get(chunkX + dx, chunkZ + dz);
+			added->neighbors[(dz + 1) * 3 + (dx + 1)].store(neighbor, std::memory_order_release);
+			if(neighbor)
+				neighbor->neighbors[(1 - dz) * 3 + (1 - dx)].store(added, std::memory_order_release);
+		}
+	}
+	return added;
+}
+
+size_t ChunkMap::size() const
+{
+	return count;
+}
+
+size_t ChunkMap::memoryUsage() const
+{
+	return entries.capacity() * sizeof(Entry);
+}
+
+std::vector<Chunk*> ChunkMap::all() const
+{
+	std::vector<Chunk*> chunks;
+	chunks.reserve(count);
+	for(auto &entry : entries)
+		if(entry.chunk)
+			chunks.push_back(entry.chunk.get());
+	return chunks;
+}
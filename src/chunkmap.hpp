@@ -0,0 +1,47 @@
+#ifndef __CHUNKMAP_H__
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <memory>
+#include "chunk.hpp"
+
+//Open addressing hash map (linear probing) from
+//chunk coordinates to chunks, chunks are heap allocated
+//so pointers to them stay valid when the table grows
+class ChunkMap
+{
+	struct Entry
+	{
+		uint64_t key = 0;
+		std::unique_ptr<Chunk> chunk;
+	};
+
+	std::vector<Entry> entries;
+	size_t count = 0;
+	//log2 of the number of entries
+	uint32_t capacityBits = 0;
+
+	size_t slot(uint64_t key) const;
+	void grow();
+public:
+	ChunkMap();
+
+	//Returns nullptr if the chunk is not loaded
+	Chunk* get(int32_t chunkX, int32_t chunkZ) const;
+	//Takes ownership of the chunk and returns it. If there already is
+	//a chunk at the coordinates that one is kept and returned and the
+	//new chunk is destroyed, other chunks and threads may point at
+	//loaded chunks so they are never replaced.
+	//Links the chunk and the chunks around it (see Chunk::neighbors)
+	Chunk* insert(int32_t chunkX, int32_t chunkZ, std::unique_ptr<Chunk> chunk);
+	size_t size() const;
+	//Returns the number of bytes used by the table itself,
+	//not including the chunks
+	size_t memoryUsage() const;
+	//Returns all loaded chunks (in no particular order)
+	std::vector<Chunk*> all() const;
+};
+
+#endif
+
+#define __CHUNKMAP_H__
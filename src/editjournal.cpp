@@ -0,0 +1,139 @@
+#include "editjournal.hpp"
+#include <iostream>
+
+size_t EditTransaction::memoryUsage() const
+{
+	return runs.capacity() * sizeof(EditRun) + 
+		   oldBlocks.capacity() + 
+		   newBlocks.capacity() +
+		   sizeof(EditTransaction);
+}
+
+void EditJournal::record(int32_t x, int32_t y, int32_t z, uint8_t oldBlock, uint8_t newBlock)
+{
+	if(oldBlock == newBlock || overflowed)
+		return;
+
+	if(current.runs.empty())
+	{
+		current.minPos = current.maxPos = glm::ivec3(x, y, z);
+	}
+	else
+	{
+		current.minPos = glm::min(current.minPos, glm::ivec3(x, y, z));
+		current.maxPos = glm::max(current.maxPos, glm::ivec3(x, y, z));
+	}
+
+	//Extend the last run if the block is right after it
+	EditRun *last = current.runs.empty() ? nullptr : &current.runs.back();
+	if(last && last->y == y && last->z == z && last->x + int32_t(last->length) == x)
+		last->length++;
+	else
+		current.runs.push_back({ x, y, z, 1 });
+
+	current.oldBlocks.push_back(oldBlock);
+	current.newBlocks.push_back(newBlock);
+
+	//The open transaction counts towards the limit as well so that
+	//a huge edit cannot use unbounded memory, older history is
+	//dropped first to make room for it
+	if(usage + current.memoryUsage() > limit)
+		trim(current.memoryUsage());
+	if(usage + current.memoryUsage() > limit)
+	{
+		std::cerr << "Edit is too large to undo (over " << limit << " bytes)\n";
+		overflowed = true;
+		current = EditTransaction();
+	}
+}
+
+void EditJournal::commit()
+{
+	if(overflowed)
+	{
+		//Part of the edit was not recorded so none of it can be undone,
+		//older transactions may now be undone on top of the wrong blocks
+		overflowed = false;
+		clear();
+		return;
+	}
+
+	if(current.runs.empty())
+		return;
+
+	current.runs.shrink_to_fit();
+	current.oldBlocks.shrink_to_fit();
+	current.newBlocks.shrink_to_fit();
+
+	for(auto &transaction : redoStack)
+		usage -= transaction.memoryUsage();
+	redoStack.clear();
+
+	usage += current.memoryUsage();
+	undoStack.push_back(std::move(current));
+	current = EditTransaction();
+	trim(0);
+}
+
+void EditJournal::trim(size_t reserve)
+{
+	while(usage + reserve > limit && !undoStack.empty())
+	{
+		usage -= undoStack.front().memoryUsage();
+		undoStack.pop_front();
+	}
+	while(usage + reserve > limit && !redoStack.empty())
+	{
+		usage -= redoStack.front().memoryUsage();
+		redoStack.pop_front();
+	}
+}
+
+const EditTransaction* EditJournal::takeUndo()
+{
+	if(undoStack.empty())
+		return nullptr;
+
+	redoStack.push_back(std::move(undoStack.back()));
+	undoStack.pop_back();
+	return &redoStack.back();
+}
+
+const EditTransaction* EditJournal::takeRedo()
+{
+	if(redoStack.empty())
+		return nullptr;
+
+	undoStack.push_back(std::move(redoStack.back()));
+	redoStack.pop_back();
+	return &undoStack.back();
+}
+
+size_t EditJournal::undoCount() const
+{
+	return undoStack.size();
+}
+
+size_t EditJournal::redoCount() const
+{
+	return redoStack.size();
+}
+
+size_t EditJournal::memoryUsage() const
+{
+	return usage + current.memoryUsage();
+}
+
+void EditJournal::setLimit(size_t bytes)
+{
+	limit = bytes;
+	trim(0);
+}
+
+void EditJournal::clear()
+{
+	undoStack.clear();
+	redoStack.clear();
+	current = EditTransaction();
+	usage = 0;
+}
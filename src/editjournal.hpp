@@ -0,0 +1,73 @@
+#ifndef __EDITJOURNAL_H__
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <deque>
+#include <glm/glm.hpp>
+
+//Default limit on the memory used by the undo and redo history
+const size_t DEFAULT_JOURNAL_LIMIT = 64 * 1024 * 1024;
+
+//Blocks next to each other along x that changed, the old and new
+//blocks of the run are stored one after the other in the
+//transaction's block arrays in the same order as the runs
+struct EditRun
+{
+	int32_t x, y, z;
+	uint32_t length;
+};
+
+//Every block changed by one edit (or by several edits
+//grouped together with World::beginEdit/endEdit)
+struct EditTransaction
+{
+	std::vector<EditRun> runs;
+	std::vector<uint8_t> oldBlocks, newBlocks;
+	//Box (inclusive) around every block in the transaction
+	glm::ivec3 minPos, maxPos;
+
+	size_t memoryUsage() const;
+};
+
+//Undo and redo history of block edits, older transactions
+//are thrown away once the history uses more than its limit.
+//Not thread safe, World only uses it while holding journalLock
+class EditJournal
+{
+	std::deque<EditTransaction> undoStack, redoStack;
+	EditTransaction current;
+	//Set if the open transaction did not fit in the limit,
+	//the rest of it is not recorded
+	bool overflowed = false;
+	size_t limit = DEFAULT_JOURNAL_LIMIT;
+	size_t usage = 0;
+
+	//Drops the oldest transactions until the history
+	//and reserve more bytes fit in the limit
+	void trim(size_t reserve);
+public:
+	//Records a block change in the open transaction,
+	//changes that do not change the block are ignored
+	void record(int32_t x, int32_t y, int32_t z, uint8_t oldBlock, uint8_t newBlock);
+	//Closes the open transaction and adds it to the undo history,
+	//this clears the redo history if the transaction changed anything
+	void commit();
+
+	//Moves the newest transaction from the undo history to the
+	//redo history (or the other way for takeRedo) and returns it,
+	//returns nullptr if there is nothing to undo or redo.
+	//The pointer is valid until the journal is next changed
+	const EditTransaction* takeUndo();
+	const EditTransaction* takeRedo();
+
+	size_t undoCount() const;
+	size_t redoCount() const;
+	//Bytes used by the undo and redo history
+	size_t memoryUsage() const;
+	void setLimit(size_t bytes);
+	void clear();
+};
+
+#endif
+
+#define __EDITJOURNAL_H__
@@ -20,6 +20,12 @@ const float ZNEAR = 0.1f;
 const float ZFAR = 1024.0f;
 const int WORLD_SIZE = 256;
 const uint32_t RENDER_DIST = WORLD_SIZE / (CHUNK_SIZE * 2);
+//Maximum number of new chunks generated each frame
+const uint32_t CHUNKS_PER_FRAME = 2;
+//Seconds between writing changes to the world file
+const double SYNC_INTERVAL = 30.0;
+//Chunks that have not been used for this many seconds are compressed
+const double COLD_CHUNK_TIME = 60.0;
 
 struct State
 {
@@ -61,6 +67,10 @@ void handleKeyInput(GLFWwindow *win, int key, int scancode, int action, int mods
 	state->player.handleKeyInput(key, action);
 	state->player.selectBlock(key);
 
+	//Respawn
+	if(key == GLFW_KEY_R && action == GLFW_PRESS)
+		state->player.respawn(state->world);
+
 	//Output player position
 	if(key == GLFW_KEY_P && action == GLFW_PRESS)
 	{
@@ -69,6 +79,19 @@ void handleKeyInput(GLFWwindow *win, int key, int scancode, int action, int mods
 					 state->player.hitbox.position.y << ", " <<
 					 state->player.hitbox.position.z << '\n';
 	}
+
+	//Output memory usage
+	if(key == GLFW_KEY_M && action == GLFW_PRESS)
+	{
+		state->world.memoryStats().print(std::cerr);
+		state->world.sectionDedupStats().print(std::cerr);
+	}
+
+	//Undo and redo block edits
+	if(key == GLFW_KEY_Z && (mods & GLFW_MOD_CONTROL) && action == GLFW_PRESS)
+		state->world.undo();
+	if(key == GLFW_KEY_Y && (mods & GLFW_MOD_CONTROL) && action == GLFW_PRESS)
+		state->world.redo();
 };
 
 void handleMouseInput(GLFWwindow *win, int button, int action, int mods)
@@ -106,24 +129,7 @@ void handleMouseInput(GLFWwindow *win, int button, int action, int mods)
 				y = (int32_t)floorf(pos.y),
 				z = (int32_t)floorf(pos.z);
 
-		int32_t chunkX = x / CHUNK_SIZE,
-				chunkZ = z / CHUNK_SIZE;
-		if(z < 0 && z % CHUNK_SIZE != 0)
-			chunkZ--;
-		if(x < 0 && x % CHUNK_SIZE != 0)
-			chunkX--;
-
 		state->world.setBlock(x, y, z, AIR);
-		state->world.buildChunk(chunkX, chunkZ);
-
-		if(x % CHUNK_SIZE == 0 || (x - 1) % CHUNK_SIZE == 0)
-			state->world.buildChunk(chunkX - 1, chunkZ);	
-		if((x + 1) % CHUNK_SIZE == 0 || x % CHUNK_SIZE == 0)
-			state->world.buildChunk(chunkX + 1, chunkZ);
-		if((z - 1) % CHUNK_SIZE == 0 || z % CHUNK_SIZE == 0)
-			state->world.buildChunk(chunkX, chunkZ - 1);	
-		if((z + 1) % CHUNK_SIZE == 0 || z % CHUNK_SIZE == 0)
-			state->world.buildChunk(chunkX, chunkZ + 1);	
 	}
 
 	//Place block
@@ -165,28 +171,11 @@ void handleMouseInput(GLFWwindow *win, int button, int action, int mods)
 		if(intersecting(block, state->player.hitbox))
 			return;
 
-		int32_t chunkX = x / CHUNK_SIZE,
-				chunkZ = z / CHUNK_SIZE;
-		if(z < 0 && z % CHUNK_SIZE != 0)
-			chunkZ--;
-		if(x < 0 && x % CHUNK_SIZE != 0)
-			chunkX--;
-
 		state->world.setBlock(x, y, z, state->player.selectedBlock);
-		state->world.buildChunk(chunkX, chunkZ);
-
-		if(x % CHUNK_SIZE == 0 || (x - 1) % CHUNK_SIZE == 0)
-			state->world.buildChunk(chunkX - 1, chunkZ);	
-		if((x + 1) % CHUNK_SIZE == 0 || x % CHUNK_SIZE == 0)
-			state->world.buildChunk(chunkX + 1, chunkZ);
-		if((z - 1) % CHUNK_SIZE == 0 || z % CHUNK_SIZE == 0)
-			state->world.buildChunk(chunkX, chunkZ - 1);	
-		if((z + 1) % CHUNK_SIZE == 0 || z % CHUNK_SIZE == 0)
-			state->world.buildChunk(chunkX, chunkZ + 1);
 	}
 }
 
-int main()
+int main(int argc, char *argv[])
 {			
 	srand(0);
 
@@ -274,6 +263,10 @@ int main()
 
 	//Create world
 	{
+		//Blockgame [world file]
+		if(argc > 1 && !gameState.world.openWorldFile(argv[1]))
+			std::cerr << "World will not be saved\n";
+
 		double start = glfwGetTime();
 		gameState.world.generateWorld();
 		std::cerr << "Time to generate world: " << glfwGetTime() - start << " sec \n";
@@ -281,12 +274,17 @@ int main()
 		start = glfwGetTime();
 		gameState.world.buildAllChunks();		
 		std::cerr << "Time to build chunks: " << glfwGetTime() - start << " sec \n";
+		gameState.world.memoryStats().print(std::cerr);
+		gameState.world.sectionDedupStats().print(std::cerr);
+
+		gameState.player.respawn(gameState.world);
 	}
 
 	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
 	int framesDrawn = 0;
 	double frameTimer = 0.0;
+	double syncTimer = 0.0;
 
 	while(!glfwWindowShouldClose(win))
 	{
@@ -308,6 +306,9 @@ int main()
 			windowAspectRatio(win)
 		);
 
+		//Rebuild the chunks that were changed last frame
+		gameState.world.buildDirtyChunks();
+
 		int triCount = gameState.world.displayWorld(
 			viewFrustum, 
 			gameState.player.getCamera().position, 
@@ -317,6 +318,15 @@ int main()
 		//Update camera
 		gameState.player.move((float)dt, gameState.world);
 
+		//Generate chunks as the player explores,
+		//a few at a time to avoid stuttering
+		gameState.world.generateChunksAround(
+			worldToChunkCoord((int32_t)floorf(gameState.player.hitbox.position.x)),
+			worldToChunkCoord((int32_t)floorf(gameState.player.hitbox.position.z)),
+			RENDER_DIST,
+			CHUNKS_PER_FRAME
+		);
+
 		{
 			glm::vec3 pos = raycast(
 				gameState.world, 
@@ -369,8 +379,21 @@ int main()
 					  << " |  Triangles drawn: (" << triCount << ") \n";
 			framesDrawn = 0;
 			frameTimer = 0.0;
+
+			gameState.world.compressColdChunks(glfwGetTime(), COLD_CHUNK_TIME);
 		}
 		framesDrawn++;
+
+		syncTimer += dt;
+		if(syncTimer > SYNC_INTERVAL)
+		{
+			//Chunks generated since the last sync share their sections
+			//with the rest of the world, this goes through every chunk
+			//so it runs next to the game instead of stalling a frame
+			gameState.world.startDedupSections();
+			gameState.world.syncWorldFile(false);
+			syncTimer = 0.0;
+		}
 	}
 
 	gameState.world.deleteBuffers();
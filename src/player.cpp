@@ -64,13 +64,6 @@ void Player::handleKeyInput(int key, int action)
 		jumping = true;
 	else if(key == GLFW_KEY_SPACE && action == GLFW_RELEASE)
 		jumping = false;
-
-	//Respawn
-	if(key == GLFW_KEY_R && action == GLFW_PRESS)
-	{
-		hitbox.position = glm::vec3(0.0f, 128.0f, 0.0f);
-		yvelocity = 0.0f;
-	}
 }
 
 void Player::selectBlock(int key)
@@ -168,10 +161,7 @@ void Player::move(float dt, World &world)
 	}
 
 	if(hitbox.position.y < -256.0f)
-	{
-		hitbox.position = glm::vec3(0.0f, 128.0f, 0.0f);
-		yvelocity = 0.0f;	
-	}
+		respawn(world);
 
 	//Fly
 	/*switch(flyingDirection)
@@ -224,6 +214,18 @@ void Player::move(float dt, World &world)
 	hitbox = uncollideZ(hitbox, block);
 }
 
+void Player::respawn(World &world)
+{
+	int32_t height = world.getHeight(0, 0);
+	//Spawn chunk has not been generated yet, drop in from above
+	if(height < 0)
+		height = 128;
+
+	//Block hitboxes go from y to y + 1
+	hitbox.position = glm::vec3(0.0f, height + 1.0f + hitbox.dimensions.y / 2.0f, 0.0f);
+	yvelocity = 0.0f;
+}
+
 Camera Player::getCamera()
 {
 	glm::vec3 offset = glm::vec3(0.0f, 0.3f, 0.0f);
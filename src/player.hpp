@@ -53,6 +53,8 @@ public:
 	void selectBlock(int key);
 	void handleMouseMovement(GLFWwindow *win, float oldMousex, float oldMousey, float dt);
 	void move(float dt, World &world);
+	//Moves the player to the top of the column at (0, 0)
+	void respawn(World &world);
 	Camera getCamera();
 };
 
@@ -0,0 +1,166 @@
+#include "schematic.hpp"
+#include "chunk.hpp"
+#include "blocks.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include <algorithm>
+
+const char SCHEMATIC_MAGIC[4] = { 'B', 'G', 'S', 'C' };
+const uint32_t SCHEMATIC_VERSION = 1;
+//Largest schematic that will be loaded (in blocks), keeps a bad header
+//from making load allocate more than 64 MiB of blocks
+const uint64_t MAX_SCHEMATIC_VOLUME = uint64_t(1) << 26;
+
+struct SchematicHeader
+{
+	char magic[4];
+	uint32_t version;
+	int32_t sizeX, sizeY, sizeZ;
+	//Bytes of run length encoded blocks after the header
+	uint64_t encodedSize;
+};
+
+Schematic::Schematic(glm::ivec3 size)
+{
+	this->size = size;
+	blocks = std::vector<uint8_t>(size_t(size.x) * size_t(size.y) * size_t(size.z), 0);
+}
+
+size_t Schematic::index(int32_t x, int32_t y, int32_t z) const
+{
+	return (size_t(y) * size_t(size.z) + size_t(z)) * size_t(size.x) + size_t(x);
+}
+
+uint8_t Schematic::getBlock(int32_t x, int32_t y, int32_t z) const
+{
+	return blocks[index(x, y, z)];
+}
+
+Schematic Schematic::rotated(uint32_t quarterTurns) const
+{
+	quarterTurns %= 4;
+	if(quarterTurns == 0)
+		return *this;
+
+	Schematic result(quarterTurns % 2 ? glm::ivec3(size.z, size.y, size.x) : size);
+	for(int32_t y = 0; y < size.y; y++)
+	{
+		for(int32_t z = 0; z < size.z; z++)
+		{
+			for(int32_t x = 0; x < size.x; x++)
+			{
+				int32_t newX = x, newZ = z;
+				if(quarterTurns == 1)
+				{
+					newX = size.z - 1 - z;
+					newZ = x;
+				}
+				else if(quarterTurns == 2)
+				{
+					newX = size.x - 1 - x;
+					newZ = size.z - 1 - z;
+				}
+				else
+				{
+					newX = z;
+					newZ = size.x - 1 - x;
+				}
+				result.blocks[result.index(newX, y, newZ)] = blocks[index(x, y, z)];
+			}
+		}
+	}
+	return result;
+}
+
+Schematic Schematic::mirrored() const
+{
+	Schematic result = *this;
+	for(int32_t y = 0; y < size.y; y++)
+	{
+		for(int32_t z = 0; z < size.z; z++)
+		{
+			uint8_t *row = &result.blocks[index(0, y, z)];
+			std::reverse(row, row + size.x);
+		}
+	}
+	return result;
+}
+
+bool Schematic::save(const char *path) const
+{
+	std::vector<uint8_t> encoded;
+	runLengthEncode(blocks.data(), blocks.size(), encoded);
+
+	//Clear the padding before encodedSize as well, so the same
+	//schematic always writes the same bytes and no stack memory
+	SchematicHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SCHEMATIC_MAGIC, sizeof(header.magic));
+	header.version = SCHEMATIC_VERSION;
+	header.sizeX = size.x;
+	header.sizeY = size.y;
+	header.sizeZ = size.z;
+	header.encodedSize = encoded.size();
+
+	FILE *file = fopen(path, "wb");
+	if(!file)
+	{
+		std::cerr << "Failed to open schematic file " << path << '\n';
+		return false;
+	}
+
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+			  fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+	ok = fclose(file) == 0 && ok;
+	if(!ok)
+		std::cerr << "Failed to write schematic file " << path << '\n';
+	return ok;
+}
+
+bool Schematic::load(const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	if(!file)
+	{
+		std::cerr << "Failed to open schematic file " << path << '\n';
+		return false;
+	}
+
+	SchematicHeader header;
+	std::vector<uint8_t> encoded;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+			  memcmp(header.magic, SCHEMATIC_MAGIC, sizeof(header.magic)) == 0 &&
+			  header.version == SCHEMATIC_VERSION &&
+			  header.sizeX >= 0 && header.sizeY >= 0 && header.sizeZ >= 0 &&
+			  uint64_t(header.sizeX) * uint64_t(header.sizeY) * uint64_t(header.sizeZ) <= MAX_SCHEMATIC_VOLUME &&
+			  //Every pair encodes at least one block
+			  header.encodedSize <= uint64_t(header.sizeX) * uint64_t(header.sizeY) * uint64_t(header.sizeZ) * 2;
+	if(ok)
+	{
+		encoded.resize(header.encodedSize);
+		ok = fread(encoded.data(), 1, encoded.size(), file) == encoded.size();
+	}
+	fclose(file);
+
+	size_t volume = ok ? size_t(header.sizeX) * size_t(header.sizeY) * size_t(header.sizeZ) : 0;
+	if(!ok || runLengthDecodedSize(encoded) != volume)
+	{
+		std::cerr << "Schematic file " << path << " is not valid\n";
+		return false;
+	}
+
+	for(size_t i = 1; i < encoded.size(); i += 2)
+	{
+		if(encoded[i] >= BLOCK_TYPE_COUNT)
+		{
+			std::cerr << "Schematic file " << path << " has unknown block " << int(encoded[i]) << '\n';
+			return false;
+		}
+	}
+
+	size = glm::ivec3(header.sizeX, header.sizeY, header.sizeZ);
+	blocks.resize(volume);
+	runLengthDecode(encoded, blocks.data());
+	return true;
+}
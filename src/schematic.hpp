@@ -0,0 +1,41 @@
+#ifndef __SCHEMATIC_H__
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+//A box of blocks copied out of a world (see World::copyRegion)
+//that can be pasted back into any world with World::pasteRegion.
+//
+//File layout (little endian):
+//Header (magic "BGSC", version, size)
+//Blocks, run length encoded the same way as cold chunks
+struct Schematic
+{
+	//Number of blocks along each axis
+	glm::ivec3 size = glm::ivec3(0);
+	//Indexed (y * size.z + z) * size.x + x, so rows
+	//along x are contiguous like they are in sections
+	std::vector<uint8_t> blocks;
+
+	Schematic() = default;
+	//Creates a schematic filled with air
+	Schematic(glm::ivec3 size);
+
+	size_t index(int32_t x, int32_t y, int32_t z) const;
+	uint8_t getBlock(int32_t x, int32_t y, int32_t z) const;
+	//Returns a copy turned quarterTurns * 90 degrees
+	//clockwise around the y axis (looking down)
+	Schematic rotated(uint32_t quarterTurns) const;
+	//Returns a copy flipped along the x axis
+	Schematic mirrored() const;
+
+	//Both return false and print an error on failure, load refuses
+	//schematics over 2^26 blocks and blocks that do not exist
+	bool save(const char *path) const;
+	bool load(const char *path);
+};
+
+#endif
+
+#define __SCHEMATIC_H__
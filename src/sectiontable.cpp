@@ -0,0 +1,61 @@
+#include "sectiontable.hpp"
+#include <string.h>
+
+//Hashes every block in a decoded section 8 at a time
+static uint64_t hashBlocks(const uint8_t *blocks)
+{
+	uint64_t h = 0x9e3779b97f4a7c15ull;
+	for(uint32_t i = 0; i < SECTION_VOLUME; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, blocks + i, sizeof(word));
+		h = (h ^ word) * 0xff51afd7ed558ccdull;
+		h ^= h >> 32;
+	}
+	return h;
+}
+
+void SectionTable::intern(ChunkSection &section)
+{
+	if(section.isUniform())
+		return;
+
+	//Compare decoded blocks, the same blocks can
+	//have their palette in a different order
+	uint8_t blocks[SECTION_VOLUME], other[SECTION_VOLUME];
+	section.getBlocks(blocks);
+	uint64_t hash = hashBlocks(blocks);
+
+	std::lock_guard guard(lock);
+	auto range = sections.equal_range(hash);
+	for(auto it = range.first; it != range.second; it++)
+	{
+		if(it->second.dataId() == section.dataId())
+			return;
+
+		it->second.getBlocks(other);
+		if(memcmp(blocks, other, SECTION_VOLUME) == 0)
+		{
+			section = it->second;
+			return;
+		}
+	}
+
+	sections.emplace(hash, section);
+}
+
+size_t SectionTable::size() const
+{
+	std::lock_guard guard(lock);
+	return sections.size();
+}
+
+size_t SectionTable::memoryUsage() const
+{
+	std::lock_guard guard(lock);
+	size_t total = sections.bucket_count() * sizeof(void*);
+	for(auto &entry : sections)
+		//Each entry is a node holding the hash and the section
+		total += entry.second.memoryUsage() + sizeof(uint64_t) + sizeof(void*);
+	return total;
+}
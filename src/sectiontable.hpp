@@ -0,0 +1,31 @@
+#ifndef __SECTIONTABLE_H__
+#include <stdint.h>
+#include <stddef.h>
+#include <unordered_map>
+#include <mutex>
+#include "chunk.hpp"
+
+//Hash consing for chunk sections, sections with the same blocks are
+//made to share one copy of their data. Sections are already copy on
+//write, so a shared section gets its own data back the first time it
+//is changed. The table keeps a copy of every section it has seen, so
+//the data of those sections stays alive as long as the table does.
+//Thread safe, the sections passed in have to be locked by the caller
+class SectionTable
+{
+	//Hash of the blocks -> sections with those blocks
+	std::unordered_multimap<uint64_t, ChunkSection> sections;
+	mutable std::mutex lock;
+public:
+	//Makes section share its data with an earlier section that has
+	//the same blocks, or remembers it if there is none yet.
+	//Uniform sections have no data and are left alone
+	void intern(ChunkSection &section);
+	size_t size() const;
+	//Bytes used by the table and its share of the section data
+	size_t memoryUsage() const;
+};
+
+#endif
+
+#define __SECTIONTABLE_H__
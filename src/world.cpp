@@ -1,188 +1,1785 @@
 #include "world.hpp"
+#include "blockalloc.hpp"
 #include <glad/glad.h>
 #include <math.h>
+#include <string.h>
 #include <iostream>
 #define STB_PERLIN_IMPLEMENTATION
 #include <stb_perlin.h>
 #include <thread>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <unordered_set>
+#include <tuple>
+
+const float FREQUENCY = 128.0f;
+const float CAVE_FREQUENCY = 16.0f;
+//Terrain never reaches this high, caves get rarer towards it
+//so a taller world has the same terrain with more sky above it
+const uint32_t TERRAIN_HEIGHT = 128;
+//1 in TREE_CHANCE grass blocks have a tree on them
+const uint32_t TREE_CHANCE = 1000;
+
+//Returns a pseudo random number for a column of blocks,
+//this is used instead of rand() so that chunks can be
+//generated in any order and still produce the same world
+static uint32_t columnRandom(int32_t x, int32_t z, uint32_t salt)
+{
+	uint64_t h = (uint64_t(uint32_t(x)) << 32) | uint64_t(uint32_t(z));
+	h ^= uint64_t(salt) * 0x9e3779b97f4a7c15ull;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return uint32_t(h);
+}
+
+//Returns the height of the terrain (before caves are carved out)
+static float terrainHeight(int32_t x, int32_t z)
+{
+	float height = stb_perlin_fbm_noise3(
+		(float)x / FREQUENCY,
+		0.0f,
+		(float)z / FREQUENCY,
+		2.0f,
+		0.5f,
+		4
+	);
+
+	bool negative = height < 0.0f;
+	height *= height;
+	if(negative)
+		height *= -1.25f;
+	else
+		height *= 1.25f;
+
+	height *= 32.0f;
+	height += 64.0f;
+
+	return height;
+}
+
+//Region queries that cover at least this many
+//chunks are split over several threads
+const size_t QUERY_PARALLEL_CHUNKS = 16;
+
+//Number of section meshes that are kept in memory at once
+//while building all chunks before they are uploaded
+const size_t MESH_BATCH_SIZE = 2048;
+
+//Calls func(i) for every i in [0, count) using one thread
+//per hardware thread instead of one thread per item
+static void parallelFor(size_t count, const std::function<void(size_t)> &func)
+{
+	size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+	threadCount = std::min(threadCount, count);
+
+	std::atomic<size_t> next(0);
+	auto worker = [&next, count, &func]() {
+		for(size_t i = next++; i < count; i = next++)
+			func(i);
+	};
+
+	std::vector<std::thread> threads;	
+	for(size_t i = 0; i < threadCount; i++)
+		threads.push_back(std::thread(worker));
+
+	for(auto &thread : threads)
+		thread.join();
+}
+
+World::World(uint32_t size, uint32_t height)
+{
+	worldSize = size;
+	//The heightmaps store heights as 16 bit integers
+	worldHeight = std::min(height, MAX_WORLD_HEIGHT);
+}
+
+World::~World()
+{
+	if(dedupThread.joinable())
+		dedupThread.join();
+	deleteBuffers();
+}
+
+bool World::openWorldFile(const char *path)
+{
+	std::unique_lock lock(fileLock);
+	return file.open(path, worldHeight);
+}
+
+void World::syncWorldFile(bool wait)
+{
+	std::shared_lock lock(fileLock);
+	file.sync(wait);
+}
+
+uint32_t World::chunkLockIndex(int32_t chunkX, int32_t chunkZ)
+{
+	//Spreads neighboring chunks over different locks
+	uint32_t h = uint32_t(chunkX) * 73856093u ^ uint32_t(chunkZ) * 19349663u;
+	return (h ^ (h >> 16)) % CHUNK_LOCK_STRIPES;
+}
+
+Chunk* World::findChunk(int32_t chunkX, int32_t chunkZ) const
+{
+	std::shared_lock lock(chunkMapLock);
+	return chunks.get(chunkX, chunkZ);
+}
+
+std::vector<Chunk*> World::allChunks() const
+{
+	std::shared_lock lock(chunkMapLock);
+	return chunks.all();
+}
+
+void World::thawChunk(Chunk *chunk)
+{
+	chunk->lastAccess.store(clock.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	if(chunk->cold)
+	{
+		coldMisses++;
+		coldChunkCount--;
+		chunk->decompressBlocks();
+	}
+	else
+	{
+		coldHits++;
+	}
+}
+
+std::shared_lock<std::shared_mutex> World::lockChunkShared(Chunk *chunk)
+{
+	std::shared_mutex &mutex = chunkLocks[chunkLockIndex(chunk->chunkX, chunk->chunkZ)];
+	while(true)
+	{
+		std::shared_lock lock(mutex);
+		if(!chunk->cold)
+		{
+			coldHits++;
+			chunk->lastAccess.store(clock.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			return lock;
+		}
+		lock.unlock();
+
+		//Decompressing changes the chunk, the chunk can
+		//become cold again before the shared lock is retaken
+		std::unique_lock exclusive(mutex);
+		thawChunk(chunk);
+	}
+}
+
+std::unique_lock<std::shared_mutex> World::lockChunk(Chunk *chunk)
+{
+	std::unique_lock lock(chunkLocks[chunkLockIndex(chunk->chunkX, chunk->chunkZ)]);
+	thawChunk(chunk);
+	return lock;
+}
+
+std::vector<std::unique_lock<std::shared_mutex>> World::lockChunks(int32_t minChunkX, int32_t minChunkZ,
+																   int32_t maxChunkX, int32_t maxChunkZ)
+{
+	//Taking the locks in stripe order means two threads
+	//locking overlapping boxes cannot deadlock
+	std::vector<uint32_t> stripes;
+	for(int32_t x = minChunkX; x <= maxChunkX; x++)
+		for(int32_t z = minChunkZ; z <= maxChunkZ; z++)
+			stripes.push_back(chunkLockIndex(x, z));
+	std::sort(stripes.begin(), stripes.end());
+	stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+
+	std::vector<std::unique_lock<std::shared_mutex>> locks;
+	for(uint32_t stripe : stripes)
+		locks.emplace_back(chunkLocks[stripe]);
+
+	for(int32_t x = minChunkX; x <= maxChunkX; x++)
+		for(int32_t z = minChunkZ; z <= maxChunkZ; z++)
+			if(Chunk *chunk = findChunk(x, z))
+				thawChunk(chunk);
+
+	return locks;
+}
+
+bool World::loadChunk(Chunk *chunk)
+{
+	std::shared_lock lock(fileLock);
+	int32_t chunkX = chunk->chunkX,
+			chunkZ = chunk->chunkZ;
+	if(!file.hasChunk(chunkX, chunkZ))
+		return false;
+
+	//Sections that are not stored are air
+	std::vector<uint8_t> blocks(size_t(file.sectionCount(chunkX, chunkZ)) * SECTION_VOLUME, 0);
+	for(size_t i = 0; i < blocks.size() / SECTION_VOLUME; i++)
+		if(const uint8_t *section = file.section(chunkX, int32_t(i), chunkZ))
+			memcpy(blocks.data() + i * SECTION_VOLUME, section, SECTION_VOLUME);
+	chunk->setBlocks(blocks.data(), blocks.size() / SECTION_VOLUME);
+	chunk->decorated = file.isDecorated(chunkX, chunkZ);
+	chunk->saved = true;
+
+	//A size of 0 means the chunk has no block entities
+	const uint8_t *entities = file.blockEntitySlot(chunkX, chunkZ);
+	if(!entities)
+		return true;
+	uint32_t size;
+	memcpy(&size, entities, sizeof(size));
+	if(size > 0 &&
+	   (size > BLOCK_ENTITY_SLOT_BYTES - sizeof(size) ||
+		!chunk->blockEntities.deserialize(entities + sizeof(size), size)))
+		std::cerr << "Block entities of chunk " << chunkX << ", " << chunkZ << " are damaged and were not loaded\n";
+	return true;
+}
+
+void World::saveChunk(Chunk *chunk)
+{
+	if(!chunk->saved)
+	{
+		//Adding a chunk can move the mapping
+		std::unique_lock lock(fileLock);
+		if(!file.isOpen())
+			return;
+		if(!file.addChunk(chunk->chunkX, chunk->chunkZ))
+		{
+			std::cerr << "World file is full, chunk " << chunk->chunkX << ", " << chunk->chunkZ << " will not be saved\n";
+			return;
+		}
+		chunk->saved = true;
+		if(chunk->decorated)
+			file.setDecorated(chunk->chunkX, chunk->chunkZ);
+	}
+	else if(chunk->decorated)
+	{
+		std::shared_lock lock(fileLock);
+		file.setDecorated(chunk->chunkX, chunk->chunkZ);
+	}
+
+	//Sections above the top of the chunk are air and
+	//are left as they are, so they are never stored
+	uint8_t blocks[SECTION_VOLUME];
+	for(size_t i = 0; i < chunk->sections.size(); i++)
+	{
+		chunk->sections[i].getBlocks(blocks);
+		saveSection(chunk, int32_t(i), blocks);
+	}
+	saveBlockEntities(chunk);
+}
+
+void World::saveBlockEntities(Chunk *chunk)
+{
+	if(!chunk->saved)
+		return;
+
+	//Only write the empty size if there were entities before,
+	//so nothing is added or dirtied for chunks that never had any
+	if(chunk->blockEntities.empty())
+	{
+		std::shared_lock lock(fileLock);
+		uint8_t *entities = file.blockEntitySlot(chunk->chunkX, chunk->chunkZ);
+		uint32_t size = 0;
+		if(entities)
+			memcpy(entities, &size, sizeof(size));
+		return;
+	}
+
+	uint32_t size = chunk->blockEntities.serializedSize();
+	if(size > BLOCK_ENTITY_SLOT_BYTES - sizeof(size))
+	{
+		std::cerr << "Block entities of chunk " << chunk->chunkX << ", " << chunk->chunkZ << " do not fit in the world file, they were not saved\n";
+		return;
+	}
+
+	{
+		std::shared_lock lock(fileLock);
+		if(uint8_t *entities = file.blockEntitySlot(chunk->chunkX, chunk->chunkZ))
+		{
+			memcpy(entities, &size, sizeof(size));
+			chunk->blockEntities.serialize(entities + sizeof(size));
+			return;
+		}
+	}
+
+	//The first entities of a chunk get their area in the file
+	std::unique_lock lock(fileLock);
+	uint8_t *entities = file.addBlockEntitySlot(chunk->chunkX, chunk->chunkZ);
+	if(!entities)
+	{
+		std::cerr << "World file is full, block entities of chunk " << chunk->chunkX << ", " << chunk->chunkZ << " will not be saved\n";
+		return;
+	}
+	memcpy(entities, &size, sizeof(size));
+	chunk->blockEntities.serialize(entities + sizeof(size));
+}
+
+void World::generateTerrain(Chunk *chunk)
+{
+	int32_t chunkX = chunk->chunkX,
+			chunkZ = chunk->chunkZ;
+
+	// Fill in the world with blocks
+	for(int32_t x = chunkX * CHUNK_SIZE; x < chunkX * CHUNK_SIZE + CHUNK_SIZE; x++)
+	{	
+		for(int32_t z = chunkZ * CHUNK_SIZE; z < chunkZ * CHUNK_SIZE + CHUNK_SIZE; z++)
+		{
+			int32_t localX = x - chunkX * CHUNK_SIZE,
+					localZ = z - chunkZ * CHUNK_SIZE;
+
+			float height = terrainHeight(x, z);
+
+			for(int32_t y = 0; y <= (int32_t)height && y < (int32_t)worldHeight; y++)
+			{			
+				uint8_t block = AIR;
+
+				if(y == (int)height)	
+					block = GRASS;
+				else if(y <= (int)height - 1 && 
+						y >= (int)height - 4)
+					block = DIRT;	
+				else if(y < (int)height - 4)
+					block = STONE;
+
+				float cave = stb_perlin_noise3(
+					(float)x / CAVE_FREQUENCY, 
+					(float)y / CAVE_FREQUENCY,
+					(float)z / CAVE_FREQUENCY,
+					0,
+					0,
+					0
+				);
+
+				if(cave < -0.75f + 0.6f * (1.0f - float(y) / float(std::min(worldHeight, TERRAIN_HEIGHT))))
+					block = AIR;
+
+				if(y == 0)
+					block = STONE;	
+
+				if(block != AIR)
+					chunk->setBlock(localX, y, localZ, block);
+			}
+		}
+	}
+
+	//Sections that are entirely stone or air end up with no index data
+	chunk->compact();
+}
+
+bool World::decorateChunk(int32_t chunkX, int32_t chunkZ)
+{
+	//Existence checks use findChunk so that cold chunks stay compressed
+	Chunk *chunk = findChunk(chunkX, chunkZ);
+	if(!chunk)
+		return false;
+	{
+		std::shared_lock lock(chunkLocks[chunkLockIndex(chunkX, chunkZ)]);
+		if(chunk->decorated)
+			return false;
+	}
+
+	//Leaves can spill over into the surrounding chunks
+	for(int32_t dx = -1; dx <= 1; dx++)
+		for(int32_t dz = -1; dz <= 1; dz++)
+			if(!chunk->neighbor(dx, dz))
+				return false;
+
+	//Whether a tree is added depends on the blocks around it,
+	//so the chunks stay locked until all of the trees are in
+	auto locks = lockChunks(chunkX - 1, chunkZ - 1, chunkX + 1, chunkZ + 1);
+	//Another thread may have decorated the chunk in the meantime
+	if(chunk->decorated)
+		return false;
+
+	chunk->decorated = true;
+	if(chunk->saved)
+	{
+		std::shared_lock lock(fileLock);
+		file.setDecorated(chunkX, chunkZ);
+	}
+
+	//Blocks are relative to the chunk, leaves that spill over
+	//the border are reached through the chunk's neighbors
+	auto getBlock = [this, chunk](int32_t x, int32_t y, int32_t z) -> uint8_t {
+		Chunk *blockChunk = chunk->chunkAt(x, z);
+		if(y < 0 || y >= (int32_t)worldHeight || !blockChunk)
+			return AIR;
+		return blockChunk->getBlock(x, y, z);
+	};
+	auto setBlock = [this, chunk](int32_t x, int32_t y, int32_t z, uint8_t block) {
+		if(Chunk *blockChunk = chunk->chunkAt(x, z))
+			setChunkBlockLocked(blockChunk, x, y, z, block);
+	};
+
+	//Generate trees
+	for(int32_t x = 0; x < CHUNK_SIZE; x++)
+	{
+		for(int32_t z = 0; z < CHUNK_SIZE; z++)
+		{	
+			if(columnRandom(x + chunkX * CHUNK_SIZE, z + chunkZ * CHUNK_SIZE, 0) % TREE_CHANCE == 0)
+			{
+				int y = chunk->getHeight(x, z);
+				
+				if(y >= 0 && getBlock(x, y, z) == GRASS)
+				{
+					int treeHeight = columnRandom(x + chunkX * CHUNK_SIZE, z + chunkZ * CHUNK_SIZE, 1) % 4 + 4;
+					for(int i = 1; i <= treeHeight; i++)
+						setBlock(x, y + i, z, LOG);
+
+					for(int leafX = x - 2; leafX <= x + 2; leafX++)
+						for(int leafY = y + treeHeight - 2; leafY < y + treeHeight; leafY++)
+							for(int leafZ = z - 2; leafZ <= z + 2; leafZ++)
+								if(getBlock(leafX, leafY, leafZ) == AIR)
+									setBlock(leafX, leafY, leafZ, LEAVES);
+					
+					for(int leafX = x - 1; leafX <= x + 1; leafX++)
+						for(int leafZ = z - 1; leafZ <= z + 1; leafZ++)
+							if(getBlock(leafX, y + treeHeight, leafZ) == AIR)
+								setBlock(leafX, y + treeHeight, leafZ, LEAVES);
+				
+					for(int leafX = x - 1; leafX <= x + 1; leafX++)
+						for(int leafZ = z - 1; leafZ <= z + 1; leafZ++)
+							if(getBlock(leafX, y + treeHeight + 1, leafZ) == AIR &&
+							   (leafX - x) * (leafX - x) + (leafZ - z) * (leafZ - z) <= 1)
+								setBlock(leafX, y + treeHeight + 1, leafZ, LEAVES);
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+void World::generateWorld()
+{
+	std::cerr << "Building terrain...\n";
+
+	//The chunks are only added to the map once they are filled in,
+	//so other threads never see a chunk that is still being generated
+	std::vector<std::unique_ptr<Chunk>> newChunks;
+	for(int32_t x = -(int32_t)worldSize / (2 * CHUNK_SIZE); x < (int32_t)worldSize / (2 * CHUNK_SIZE); x++)
+		for(int32_t z = -(int32_t)worldSize / (2 * CHUNK_SIZE); z < (int32_t)worldSize / (2 * CHUNK_SIZE); z++)
+			if(!findChunk(x, z))
+				newChunks.push_back(std::make_unique<Chunk>(x, z));
+
+	//Start reading the saved chunks in before they are needed
+	{
+		std::shared_lock lock(fileLock);
+		for(auto &chunk : newChunks)
+			file.prefetch(chunk->chunkX, chunk->chunkZ);
+	}
+
+	//Reading from the file does not change the mapping,
+	//so saved chunks can be loaded in parallel as well
+	parallelFor(newChunks.size(), [this, &newChunks](size_t i) {
+		if(!loadChunk(newChunks[i].get()))
+			generateTerrain(newChunks[i].get());
+	});
+
+	//Adding chunks to the file can move the mapping
+	for(auto &chunk : newChunks)
+		if(!chunk->saved)
+			saveChunk(chunk.get());
+
+	std::vector<std::pair<int32_t, int32_t>> coords;
+	{
+		std::unique_lock lock(chunkMapLock);
+		for(auto &chunk : newChunks)
+		{
+			int32_t chunkX = chunk->chunkX, 
+					chunkZ = chunk->chunkZ;
+			//Chunks that are already loaded have been decorated
+			Chunk *added = chunk.get();
+			if(chunks.insert(chunkX, chunkZ, std::move(chunk)) == added)
+				coords.push_back({ chunkX, chunkZ });
+		}
+	}
+
+	for(auto [chunkX, chunkZ] : coords)
+		decorateChunk(chunkX, chunkZ);
+
+	//After the trees, so that the sections they
+	//changed are only compared once
+	dedupSections();
+}
+
+void World::generateChunksAround(int32_t chunkX, int32_t chunkZ, int32_t radius, uint32_t maxChunks)
+{
+	std::vector<std::pair<int32_t, int32_t>> missing;
+	for(int32_t x = chunkX - radius; x <= chunkX + radius; x++)
+		for(int32_t z = chunkZ - radius; z <= chunkZ + radius; z++)
+			if(!findChunk(x, z))
+				missing.push_back({ x, z });
+
+	if(missing.empty())
+		return;
+
+	auto dist = [chunkX, chunkZ](const std::pair<int32_t, int32_t> &c) {
+		int64_t dx = int64_t(c.first) - chunkX,
+				dz = int64_t(c.second) - chunkZ;
+		return dx * dx + dz * dz;
+	};
+	std::sort(missing.begin(), missing.end(), 
+		[&dist](const std::pair<int32_t, int32_t> &a, const std::pair<int32_t, int32_t> &b) {
+			return dist(a) < dist(b);
+		});
+	if(missing.size() > maxChunks)
+		missing.resize(maxChunks);
+
+	{
+		std::shared_lock lock(fileLock);
+		for(auto &c : missing)
+			file.prefetch(c.first, c.second);
+	}
+
+	std::vector<std::pair<int32_t, int32_t>> changed;
+	for(auto &c : missing)
+	{
+		auto chunk = std::make_unique<Chunk>(c.first, c.second);
+		if(!loadChunk(chunk.get()))
+		{
+			generateTerrain(chunk.get());
+			saveChunk(chunk.get());
+		}
+		{
+			std::unique_lock lock(chunkMapLock);
+			chunks.insert(c.first, c.second, std::move(chunk));
+		}
+
+		//The new chunk may complete the neighborhood of the chunks around it
+		for(int32_t x = c.first - 1; x <= c.first + 1; x++)
+		{
+			for(int32_t z = c.second - 1; z <= c.second + 1; z++)
+			{
+				changed.push_back({ x, z });
+				//Trees can change the chunks around the decorated chunk
+				if(decorateChunk(x, z))
+					for(int32_t i = x - 1; i <= x + 1; i++)
+						for(int32_t j = z - 1; j <= z + 1; j++)
+							changed.push_back({ i, j });
+			}
+		}
+	}
+
+	buildChunks(changed);
+}
+
+Chunk* World::getChunk(int32_t chunkX, int32_t chunkZ)
+{
+	Chunk *chunk = findChunk(chunkX, chunkZ);
+	if(!chunk)
+		return nullptr;
+
+	lockChunk(chunk);
+	return chunk;
+}
+
+void World::compressColdChunks(double now, double coldAfter)
+{
+	clock = now;
+
+	for(auto chunk : allChunks())
+	{
+		//Cheap check first so that only chunks
+		//that will be compressed get locked
+		if(now - chunk->lastAccess.load(std::memory_order_relaxed) < coldAfter)
+			continue;
+
+		std::unique_lock lock(chunkLocks[chunkLockIndex(chunk->chunkX, chunk->chunkZ)]);
+		if(chunk->cold || now - chunk->lastAccess.load(std::memory_order_relaxed) < coldAfter)
+			continue;
+
+		size_t before = chunk->memoryUsage();
+		if(!chunk->compressBlocks())
+		{
+			//Not worth compressing, check again later
+			chunk->lastAccess = now;
+			continue;
+		}
+
+		coldCompressions++;
+		coldBytesBefore += before;
+		coldBytesAfter += chunk->memoryUsage();
+		coldChunkCount++;
+	}
+}
+
+ColdChunkStats World::coldChunkStats() const
+{
+	ColdChunkStats stats;
+	stats.hits = coldHits;
+	stats.misses = coldMisses;
+	stats.compressions = coldCompressions;
+	stats.bytesBefore = coldBytesBefore;
+	stats.bytesAfter = coldBytesAfter;
+	stats.coldChunks = coldChunkCount;
+	return stats;
+}
+
+uint8_t World::getBlock(int32_t x, int32_t y, int32_t z)
+{
+	if(y < 0 || y >= (int32_t)worldHeight)
+		return AIR;
+
+	int32_t chunkX = worldToChunkCoord(x),
+			chunkZ = worldToChunkCoord(z);
+
+	Chunk *chunk = findChunk(chunkX, chunkZ);
+	if(!chunk)
+		return AIR;
+
+	auto lock = lockChunkShared(chunk);
+	return chunk->getBlock(x - chunkX * CHUNK_SIZE, y, z - chunkZ * CHUNK_SIZE);
+}
+
+ChunkBuckets World::bucketByChunk(std::span<const glm::ivec3> positions)
+{
+	//Positions are bucketed by chunk with a counting sort, first every position
+	//is given the index of its chunk's bucket with a small hash table
+	//(open addressing, power of two size, empty slots have no bucket)
+	const uint32_t NO_BUCKET = UINT32_MAX;
+	std::vector<uint64_t> tableKeys(64);
+	std::vector<uint32_t> tableBuckets(64, NO_BUCKET);
+	std::vector<uint64_t> bucketChunks;
+	std::vector<uint32_t> bucketOf(positions.size()), bucketCounts;
+
+	auto chunkKey = [](int32_t chunkX, int32_t chunkZ) {
+		return (uint64_t(uint32_t(chunkX)) << 32) | uint64_t(uint32_t(chunkZ));
+	};
+	auto insert = [&tableKeys, &tableBuckets, NO_BUCKET](uint64_t key, uint32_t bucket) {
+		size_t mask = tableKeys.size() - 1;
+		size_t i = size_t((key * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+		while(tableBuckets[i] != NO_BUCKET)
+			i = (i + 1) & mask;
+		tableKeys[i] = key;
+		tableBuckets[i] = bucket;
+	};
+
+	uint64_t lastKey = 0;
+	uint32_t lastBucket = NO_BUCKET;
+	for(size_t i = 0; i < positions.size(); i++)
+	{
+		glm::ivec3 pos = positions[i];
+		if(pos.y < 0 || pos.y >= (int32_t)worldHeight)
+		{
+			bucketOf[i] = NO_BUCKET;
+			continue;
+		}
+
+		uint64_t key = chunkKey(worldToChunkCoord(pos.x), worldToChunkCoord(pos.z));
+		//Positions often come in runs in the same chunk (rays, neighborhoods)
+		if(key != lastKey || lastBucket == NO_BUCKET)
+		{
+			size_t mask = tableKeys.size() - 1;
+			size_t slot = size_t((key * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+			while(tableBuckets[slot] != NO_BUCKET && tableKeys[slot] != key)
+				slot = (slot + 1) & mask;
+
+			if(tableBuckets[slot] != NO_BUCKET)
+			{
+				lastBucket = tableBuckets[slot];
+			}
+			else
+			{
+				lastBucket = bucketChunks.size();
+				bucketChunks.push_back(key);
+				bucketCounts.push_back(0);
+				tableKeys[slot] = key;
+				tableBuckets[slot] = lastBucket;
+
+				//Keep the table at most half full
+				if(bucketChunks.size() * 2 > tableKeys.size())
+				{
+					tableKeys.resize(tableKeys.size() * 2);
+					tableBuckets.assign(tableKeys.size(), NO_BUCKET);
+					for(uint32_t bucket = 0; bucket < bucketChunks.size(); bucket++)
+						insert(bucketChunks[bucket], bucket);
+				}
+			}
+			lastKey = key;
+		}
+
+		bucketOf[i] = lastBucket;
+		bucketCounts[lastBucket]++;
+	}
+
+	ChunkBuckets buckets;
+	//Turn the counts into where each bucket starts
+	uint32_t total = 0;
+	for(uint32_t bucket = 0; bucket < bucketChunks.size(); bucket++)
+	{
+		buckets.chunks.push_back({ int32_t(bucketChunks[bucket] >> 32), int32_t(uint32_t(bucketChunks[bucket])) });
+		buckets.start.push_back(total);
+		total += bucketCounts[bucket];
+	}
+	buckets.start.push_back(total);
+
+	//Each query only keeps what is needed to find the block
+	buckets.queries.resize(total);
+	std::vector<uint32_t> next = buckets.start;
+	for(size_t i = 0; i < positions.size(); i++)
+	{
+		if(bucketOf[i] == NO_BUCKET)
+			continue;
+
+		glm::ivec3 pos = positions[i];
+		uint32_t local = (uint32_t(pos.y) << 8) | 
+						 (uint32_t(pos.z - worldToChunkCoord(pos.z) * CHUNK_SIZE) << 4) |
+						 uint32_t(pos.x - worldToChunkCoord(pos.x) * CHUNK_SIZE);
+		buckets.queries[next[bucketOf[i]]++] = { uint32_t(i), local };
+	}
+	return buckets;
+}
+
+void World::getBlocks(std::span<const glm::ivec3> positions, std::span<uint8_t> blocks)
+{
+	size_t count = std::min(positions.size(), blocks.size());
+	//Positions outside of the world and in missing chunks stay air
+	std::fill(blocks.begin(), blocks.begin() + count, AIR);
+
+	ChunkBuckets buckets = bucketByChunk(positions.first(count));
+	for(uint32_t bucket = 0; bucket < buckets.chunks.size(); bucket++)
+	{
+		Chunk *chunk = findChunk(buckets.chunks[bucket].first, buckets.chunks[bucket].second);
+		if(!chunk)
+			continue;
+
+		auto lock = lockChunkShared(chunk);
+		for(uint32_t i = buckets.start[bucket]; i < buckets.start[bucket + 1]; i++)
+		{
+			uint32_t local = buckets.queries[i].local;
+			blocks[buckets.queries[i].index] = chunk->getBlock(local & (CHUNK_SIZE - 1), local >> 8, (local >> 4) & (CHUNK_SIZE - 1));
+		}
+	}
+}
+
+uint8_t World::getBlockLocked(int32_t x, int32_t y, int32_t z)
+{
+	if(y < 0 || y >= (int32_t)worldHeight)
+		return AIR;
+
+	int32_t chunkX = worldToChunkCoord(x),
+			chunkZ = worldToChunkCoord(z);
+
+	Chunk *chunk = findChunk(chunkX, chunkZ);
+	if(!chunk)
+		return AIR;
+
+	return chunk->getBlock(x - chunkX * CHUNK_SIZE, y, z - chunkZ * CHUNK_SIZE);
+}
+
+void World::setBlock(int32_t x, int32_t y, int32_t z, uint8_t block)
+{
+	if(y < 0 || y >= (int32_t)worldHeight)
+		return;
+
+	Chunk *chunk = findChunk(worldToChunkCoord(x), worldToChunkCoord(z));
+	if(!chunk)
+		return;
+
+	auto lock = lockChunk(chunk);
+	uint8_t oldBlock = setBlockLocked(x, y, z, block);
+
+	std::lock_guard journalGuard(journalLock);
+	journal.record(x, y, z, oldBlock, block);
+	commitEdit();
+}
+
+uint8_t World::setBlockLocked(int32_t x, int32_t y, int32_t z, uint8_t block)
+{
+	if(y < 0 || y >= (int32_t)worldHeight)
+		return AIR;
+
+	int32_t chunkX = worldToChunkCoord(x),
+			chunkZ = worldToChunkCoord(z);
+
+	Chunk *chunk = findChunk(chunkX, chunkZ);
+	if(!chunk)
+		return AIR;
+
+	return setChunkBlockLocked(chunk, x - chunkX * CHUNK_SIZE, y, z - chunkZ * CHUNK_SIZE, block);
+}
+
+uint8_t World::setChunkBlockLocked(Chunk *chunk, int32_t localX, int32_t y, int32_t localZ, uint8_t block)
+{
+	if(y < 0 || y >= (int32_t)worldHeight)
+		return AIR;
+
+	uint8_t oldBlock = chunk->getBlock(localX, y, localZ);
+	if(oldBlock == block)
+		return oldBlock;
+	size_t entityCount = chunk->blockEntities.size();
+	chunk->setBlock(localX, y, localZ, block);
+	saveBlock(chunk, localX, y, localZ, block);
+	//The block's entity was removed
+	if(chunk->blockEntities.size() != entityCount)
+		saveBlockEntities(chunk);
+
+	glm::ivec3 pos = glm::ivec3(chunk->chunkX * CHUNK_SIZE + localX, y, chunk->chunkZ * CHUNK_SIZE + localZ);
+	markDirty(pos, pos);
+	return oldBlock;
+}
+
+void World::saveBlock(Chunk *chunk, int32_t localX, int32_t y, int32_t localZ, uint8_t block)
+{
+	if(!chunk->saved)
+		return;
+
+	size_t i = chunkBlockIndex(localX, y % CHUNK_SIZE, localZ);
+	{
+		std::shared_lock lock(fileLock);
+		if(uint8_t *blocks = file.section(chunk->chunkX, y / CHUNK_SIZE, chunk->chunkZ))
+		{
+			blocks[i] = block;
+			return;
+		}
+	}
+	//Sections that are not stored are already air
+	if(block == AIR)
+		return;
+
+	//Adding a section can move the mapping
+	std::unique_lock lock(fileLock);
+	uint8_t *blocks = file.addSection(chunk->chunkX, y / CHUNK_SIZE, chunk->chunkZ);
+	if(!blocks)
+	{
+		std::cerr << "World file is full, chunk " << chunk->chunkX << ", " << chunk->chunkZ << " will not be saved\n";
+		return;
+	}
+	blocks[i] = block;
+}
+
+void World::saveSection(Chunk *chunk, int32_t sectionY, const uint8_t *blocks)
+{
+	if(!chunk->saved)
+		return;
+
+	{
+		std::shared_lock lock(fileLock);
+		if(uint8_t *stored = file.section(chunk->chunkX, sectionY, chunk->chunkZ))
+		{
+			memcpy(stored, blocks, SECTION_VOLUME);
+			return;
+		}
+	}
+	//Sections that are not stored are already air
+	if(std::all_of(blocks, blocks + SECTION_VOLUME, [](uint8_t block) { return block == AIR; }))
+		return;
+
+	//Adding a section can move the mapping
+	std::unique_lock lock(fileLock);
+	uint8_t *stored = file.addSection(chunk->chunkX, sectionY, chunk->chunkZ);
+	if(!stored)
+	{
+		std::cerr << "World file is full, chunk " << chunk->chunkX << ", " << chunk->chunkZ << " will not be saved\n";
+		return;
+	}
+	memcpy(stored, blocks, SECTION_VOLUME);
+}
+
+void World::markDirty(glm::ivec3 minPos, glm::ivec3 maxPos)
+{
+	std::lock_guard lock(dirtyLock);
+	editVersion++;
+
+	//Marks sections minSectionY -> maxSectionY of a chunk
+	int32_t topSection = ((int32_t)worldHeight - 1) / CHUNK_SIZE;
+	auto mark = [this, topSection](int32_t chunkX, int32_t minSectionY, int32_t maxSectionY, int32_t chunkZ) {
+		if(!findChunk(chunkX, chunkZ))
+			return;
+
+		for(int32_t sectionY = std::max(minSectionY, 0); sectionY <= std::min(maxSectionY, topSection); sectionY++)
+			dirtySections.push_back({ glm::ivec3(chunkX, sectionY, chunkZ), editVersion });
+	};
+
+	int32_t minX = worldToChunkCoord(minPos.x), maxX = worldToChunkCoord(maxPos.x),
+			minY = worldToChunkCoord(minPos.y), maxY = worldToChunkCoord(maxPos.y),
+			minZ = worldToChunkCoord(minPos.z), maxZ = worldToChunkCoord(maxPos.z);
+	for(int32_t x = minX; x <= maxX; x++)
+		for(int32_t z = minZ; z <= maxZ; z++)
+			mark(x, minY, maxY, z);
+
+	//Blocks on the border of a section affect the faces of the section
+	//next to it, sections that only touch the box at an edge or a
+	//corner do not share any faces with it
+	for(int32_t z = minZ; z <= maxZ; z++)
+	{
+		if(worldToChunkCoord(minPos.x - 1) != minX)
+			mark(minX - 1, minY, maxY, z);
+		if(worldToChunkCoord(maxPos.x + 1) != maxX)
+			mark(maxX + 1, minY, maxY, z);
+	}
+	for(int32_t x = minX; x <= maxX; x++)
+	{
+		if(worldToChunkCoord(minPos.z - 1) != minZ)
+			mark(x, minY, maxY, minZ - 1);
+		if(worldToChunkCoord(maxPos.z + 1) != maxZ)
+			mark(x, minY, maxY, maxZ + 1);
+
+		for(int32_t z = minZ; z <= maxZ; z++)
+		{
+			if(worldToChunkCoord(minPos.y - 1) != minY)
+				mark(x, minY - 1, minY - 1, z);
+			if(worldToChunkCoord(maxPos.y + 1) != maxY)
+				mark(x, maxY + 1, maxY + 1, z);
+		}
+	}
+}
+
+void World::fillRegion(glm::ivec3 pos1, glm::ivec3 pos2, uint8_t block)
+{
+	glm::ivec3 minPos = glm::min(pos1, pos2),
+			   maxPos = glm::max(pos1, pos2);
+	minPos.y = std::max(minPos.y, 0);
+	maxPos.y = std::min(maxPos.y, (int32_t)worldHeight - 1);
+	if(minPos.y > maxPos.y)
+		return;
+
+	auto locks = lockChunks(worldToChunkCoord(minPos.x), worldToChunkCoord(minPos.z),
+							worldToChunkCoord(maxPos.x), worldToChunkCoord(maxPos.z));
+	std::lock_guard journalGuard(journalLock);
+	for(int32_t chunkX = worldToChunkCoord(minPos.x); chunkX <= worldToChunkCoord(maxPos.x); chunkX++)
+	{
+		for(int32_t chunkZ = worldToChunkCoord(minPos.z); chunkZ <= worldToChunkCoord(maxPos.z); chunkZ++)
+		{
+			Chunk *chunk = findChunk(chunkX, chunkZ);
+			if(!chunk)
+				continue;
+
+			glm::ivec3 chunkMin = glm::ivec3(std::max(minPos.x, chunkX * CHUNK_SIZE), minPos.y, std::max(minPos.z, chunkZ * CHUNK_SIZE)),
+					   chunkMax = glm::ivec3(std::min(maxPos.x, chunkX * CHUNK_SIZE + CHUNK_SIZE - 1), maxPos.y,
+											 std::min(maxPos.z, chunkZ * CHUNK_SIZE + CHUNK_SIZE - 1));
+			//Record the blocks before they are overwritten, rows
+			//along x become a single run in the journal
+			int32_t changedMinY = INT32_MAX, changedMaxY = INT32_MIN;
+			for(int32_t y = chunkMin.y; y <= chunkMax.y; y++)
+			{
+				for(int32_t z = chunkMin.z; z <= chunkMax.z; z++)
+				{
+					for(int32_t x = chunkMin.x; x <= chunkMax.x; x++)
+					{
+						uint8_t oldBlock = chunk->getBlock(x - chunkX * CHUNK_SIZE, y, z - chunkZ * CHUNK_SIZE);
+						if(oldBlock == block)
+							continue;
+						journal.record(x, y, z, oldBlock, block);
+						changedMinY = std::min(changedMinY, y);
+						changedMaxY = std::max(changedMaxY, y);
+					}
+				}
+			}
+			//Chunks that already have the block everywhere are not saved or remeshed
+			if(changedMinY > changedMaxY)
+				continue;
+
+			chunk->fill(
+				std::max(minPos.x - chunkX * CHUNK_SIZE, 0), 
+				minPos.y,
+				std::max(minPos.z - chunkZ * CHUNK_SIZE, 0),
+				std::min(maxPos.x - chunkX * CHUNK_SIZE, CHUNK_SIZE - 1), 
+				maxPos.y,
+				std::min(maxPos.z - chunkZ * CHUNK_SIZE, CHUNK_SIZE - 1),
+				block
+			);
+			saveChunk(chunk);
+			markDirty(glm::ivec3(chunkMin.x, changedMinY, chunkMin.z), glm::ivec3(chunkMax.x, changedMaxY, chunkMax.z));
+		}
+	}
+
+	commitEdit();
+}
+
+void World::replaceInRegion(glm::ivec3 pos1, glm::ivec3 pos2, uint8_t from, uint8_t to)
+{
+	glm::ivec3 minPos = glm::min(pos1, pos2),
+			   maxPos = glm::max(pos1, pos2);
+	minPos.y = std::max(minPos.y, 0);
+	maxPos.y = std::min(maxPos.y, (int32_t)worldHeight - 1);
+	if(minPos.y > maxPos.y || from == to)
+		return;
+
+	auto locks = lockChunks(worldToChunkCoord(minPos.x), worldToChunkCoord(minPos.z),
+							worldToChunkCoord(maxPos.x), worldToChunkCoord(maxPos.z));
+	std::lock_guard journalGuard(journalLock);
+	for(int32_t chunkX = worldToChunkCoord(minPos.x); chunkX <= worldToChunkCoord(maxPos.x); chunkX++)
+	{
+		for(int32_t chunkZ = worldToChunkCoord(minPos.z); chunkZ <= worldToChunkCoord(maxPos.z); chunkZ++)
+		{
+			Chunk *chunk = findChunk(chunkX, chunkZ);
+			if(!chunk)
+				continue;
+
+			glm::ivec3 chunkMin = glm::ivec3(std::max(minPos.x, chunkX * CHUNK_SIZE), minPos.y, std::max(minPos.z, chunkZ * CHUNK_SIZE)),
+					   chunkMax = glm::ivec3(std::min(maxPos.x, chunkX * CHUNK_SIZE + CHUNK_SIZE - 1), maxPos.y,
+											 std::min(maxPos.z, chunkZ * CHUNK_SIZE + CHUNK_SIZE - 1));
+			int32_t changedMinY = INT32_MAX, changedMaxY = INT32_MIN;
+			for(int32_t y = chunkMin.y; y <= chunkMax.y; y++)
+			{
+				for(int32_t z = chunkMin.z; z <= chunkMax.z; z++)
+				{
+					for(int32_t x = chunkMin.x; x <= chunkMax.x; x++)
+					{
+						if(chunk->getBlock(x - chunkX * CHUNK_SIZE, y, z - chunkZ * CHUNK_SIZE) != from)
+							continue;
+						journal.record(x, y, z, from, to);
+						changedMinY = std::min(changedMinY, y);
+						changedMaxY = std::max(changedMaxY, y);
+					}
+				}
+			}
+			//Chunks without any `from` blocks in the box are not saved or remeshed
+			if(changedMinY > changedMaxY)
+				continue;
+
+			chunk->replace(
+				std::max(minPos.x - chunkX * CHUNK_SIZE, 0), 
+				minPos.y,
+				std::max(minPos.z - chunkZ * CHUNK_SIZE, 0),
+				std::min(maxPos.x - chunkX * CHUNK_SIZE, CHUNK_SIZE - 1), 
+				maxPos.y,
+				std::min(maxPos.z - chunkZ * CHUNK_SIZE, CHUNK_SIZE - 1),
+				from,
+				to
+			);
+			saveChunk(chunk);
+			markDirty(glm::ivec3(chunkMin.x, changedMinY, chunkMin.z), glm::ivec3(chunkMax.x, changedMaxY, chunkMax.z));
+		}
+	}
+
+	commitEdit();
+}
+
+void World::setBlocks(std::span<const glm::ivec3> positions, std::span<const uint8_t> blocks)
+{
+	size_t count = std::min(positions.size(), blocks.size());
+	ChunkBuckets buckets = bucketByChunk(positions.first(count));
+
+	//Box (inclusive, relative to the chunk) around the blocks written
+	//in each section of a chunk, every section is marked dirty once
+	int32_t sectionCount = (worldHeight + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	std::vector<std::pair<glm::ivec3, glm::ivec3>> sectionBoxes(sectionCount);
+	//Bucket + 1 for the sections that the bucket has written to
+	std::vector<uint32_t> sectionBucket(sectionCount, 0);
+	std::vector<int32_t> touchedSections;
+
+	//The whole batch is one undo step
+	beginEdit();
+	for(uint32_t bucket = 0; bucket < buckets.chunks.size(); bucket++)
+	{
+		auto [chunkX, chunkZ] = buckets.chunks[bucket];
+		Chunk *chunk = findChunk(chunkX, chunkZ);
+		if(!chunk)
+			continue;
+
+		touchedSections.clear();
+		{
+			auto lock = lockChunk(chunk);
+			std::lock_guard journalGuard(journalLock);
+			size_t entityCount = chunk->blockEntities.size();
+			//Queries keep the order of the positions, so
+			//the last write to a block is the one that stays
+			for(uint32_t i = buckets.start[bucket]; i < buckets.start[bucket + 1]; i++)
+			{
+				uint32_t local = buckets.queries[i].local;
+				glm::ivec3 pos = glm::ivec3(local & (CHUNK_SIZE - 1), local >> 8, (local >> 4) & (CHUNK_SIZE - 1));
+				uint8_t block = blocks[buckets.queries[i].index];
+
+				uint8_t oldBlock = chunk->getBlock(pos.x, pos.y, pos.z);
+				if(oldBlock == block)
+					continue;
+				chunk->setBlock(pos.x, pos.y, pos.z, block);
+				saveBlock(chunk, pos.x, pos.y, pos.z, block);
+				journal.record(chunkX * CHUNK_SIZE + pos.x, pos.y, chunkZ * CHUNK_SIZE + pos.z, oldBlock, block);
+
+				int32_t sectionY = pos.y / CHUNK_SIZE;
+				auto &box = sectionBoxes[sectionY];
+				if(sectionBucket[sectionY] != bucket + 1)
+				{
+					sectionBucket[sectionY] = bucket + 1;
+					touchedSections.push_back(sectionY);
+					box = { pos, pos };
+				}
+				box.first = glm::min(box.first, pos);
+				box.second = glm::max(box.second, pos);
+			}
+			//Some of the blocks' entities were removed
+			if(chunk->blockEntities.size() != entityCount)
+				saveBlockEntities(chunk);
+		}
+
+		glm::ivec3 offset = glm::ivec3(chunkX * CHUNK_SIZE, 0, chunkZ * CHUNK_SIZE);
+		for(int32_t sectionY : touchedSections)
+			markDirty(sectionBoxes[sectionY].first + offset, sectionBoxes[sectionY].second + offset);
+	}
+	endEdit();
+}
+
+bool World::setBlockEntity(int32_t x, int32_t y, int32_t z, std::span<const uint8_t> data)
+{
+	if(y < 0 || y >= (int32_t)worldHeight)
+		return false;
+
+	int32_t chunkX = worldToChunkCoord(x),
+			chunkZ = worldToChunkCoord(z);
+
+	Chunk *chunk = findChunk(chunkX, chunkZ);
+	if(!chunk)
+		return false;
+
+	auto lock = lockChunk(chunk);
+	int32_t localX = x - chunkX * CHUNK_SIZE,
+			localZ = z - chunkZ * CHUNK_SIZE;
+	uint8_t block = chunk->getBlock(localX, y, localZ);
+	if(block == AIR)
+		return false;
+
+	//Every chunk keeps to what fits in its slot in the world file,
+	//whether the world is saved or not
+	uint32_t key = blockEntityKey(localX, y, localZ);
+	if(data.size() > BLOCK_ENTITY_SLOT_BYTES ||
+	   chunk->blockEntities.serializedSizeAfterSet(key, data.size()) > BLOCK_ENTITY_SLOT_BYTES - sizeof(uint32_t))
+		return false;
+
+	chunk->blockEntities.set(key, block, data.data(), data.size());
+	saveBlockEntities(chunk);
+	return true;
+}
+
+bool World::getBlockEntity(int32_t x, int32_t y, int32_t z, std::vector<uint8_t> &data)
+{
+	if(y < 0 || y >= (int32_t)worldHeight)
+		return false;
+
+	int32_t chunkX = worldToChunkCoord(x),
+			chunkZ = worldToChunkCoord(z);
+
+	Chunk *chunk = findChunk(chunkX, chunkZ);
+	if(!chunk)
+		return false;
+
+	auto lock = lockChunkShared(chunk);
+	const BlockEntityMap &entities = chunk->blockEntities;
+	const BlockEntity *entity = entities.find(blockEntityKey(x - chunkX * CHUNK_SIZE, y, z - chunkZ * CHUNK_SIZE));
+	if(!entity)
+		return false;
+
+	data.assign(entities.payload(*entity), entities.payload(*entity) + entity->size);
+	return true;
+}
+
+bool World::removeBlockEntity(int32_t x, int32_t y, int32_t z)
+{
+	if(y < 0 || y >= (int32_t)worldHeight)
+		return false;
+
+	int32_t chunkX = worldToChunkCoord(x),
+			chunkZ = worldToChunkCoord(z);
+
+	Chunk *chunk = findChunk(chunkX, chunkZ);
+	if(!chunk)
+		return false;
+
+	auto lock = lockChunk(chunk);
+	if(!chunk->blockEntities.erase(blockEntityKey(x - chunkX * CHUNK_SIZE, y, z - chunkZ * CHUNK_SIZE)))
+		return false;
+	saveBlockEntities(chunk);
+	return true;
+}
+
+void World::tickBlockEntities(int32_t chunkX, int32_t chunkZ,
+							  const std::function<bool(glm::ivec3, uint8_t, std::span<uint8_t>)> &func)
+{
+	Chunk *chunk = findChunk(chunkX, chunkZ);
+	if(!chunk)
+		return;
+
+	auto lock = lockChunk(chunk);
+	BlockEntityMap &entities = chunk->blockEntities;
+	if(entities.empty())
+		return;
+
+	bool changed = false;
+	for(const auto &entity : entities.all())
+	{
+		glm::ivec3 pos = glm::ivec3(chunkX * CHUNK_SIZE + entity.x(), entity.y(), chunkZ * CHUNK_SIZE + entity.z());
+		if(func(pos, entity.block, std::span<uint8_t>(entities.payload(entity), entity.size)))
+			changed = true;
+	}
+	if(changed)
+		saveBlockEntities(chunk);
+}
+
+Schematic World::copyRegion(glm::ivec3 pos1, glm::ivec3 pos2)
+{
+	glm::ivec3 minPos = glm::min(pos1, pos2),
+			   maxPos = glm::max(pos1, pos2);
+	Schematic schematic(maxPos - minPos + glm::ivec3(1));
+
+	uint8_t sectionBlocks[SECTION_VOLUME];
+	for(int32_t chunkX = worldToChunkCoord(minPos.x); chunkX <= worldToChunkCoord(maxPos.x); chunkX++)
+	{
+		for(int32_t chunkZ = worldToChunkCoord(minPos.z); chunkZ <= worldToChunkCoord(maxPos.z); chunkZ++)
+		{
+			Chunk *chunk = findChunk(chunkX, chunkZ);
+			if(!chunk)
+				continue;
+
+			//Part of the box inside of the chunk, relative to the chunk
+			int32_t minX = std::max(minPos.x - chunkX * CHUNK_SIZE, 0),
+					maxX = std::min(maxPos.x - chunkX * CHUNK_SIZE, CHUNK_SIZE - 1),
+					minZ = std::max(minPos.z - chunkZ * CHUNK_SIZE, 0),
+					maxZ = std::min(maxPos.z - chunkZ * CHUNK_SIZE, CHUNK_SIZE - 1),
+					minY = std::max(minPos.y, 0),
+					maxY = std::min(maxPos.y, (int32_t)worldHeight - 1);
+
+			auto lock = lockChunkShared(chunk);
+			for(int32_t sectionY = minY / CHUNK_SIZE; minY <= maxY && sectionY <= maxY / CHUNK_SIZE; sectionY++)
+			{
+				const ChunkSection &section = chunk->getSection(sectionY);
+				bool uniform = section.isUniform();
+				if(uniform)
+				{
+					//Air is what the schematic starts out as
+					if(section.uniformBlock() == AIR)
+						continue;
+				}
+				else
+				{
+					section.getBlocks(sectionBlocks);
+				}
+
+				//Copy a row at a time, rows along x are contiguous in both
+				for(int32_t y = std::max(minY, sectionY * CHUNK_SIZE); y <= std::min(maxY, sectionY * CHUNK_SIZE + CHUNK_SIZE - 1); y++)
+				{
+					for(int32_t z = minZ; z <= maxZ; z++)
+					{
+						uint8_t *row = &schematic.blocks[schematic.index(
+							minX + chunkX * CHUNK_SIZE - minPos.x,
+							y - minPos.y,
+							z + chunkZ * CHUNK_SIZE - minPos.z
+						)];
+
+						if(uniform)
+							memset(row, section.uniformBlock(), maxX - minX + 1);
+						else
+							memcpy(row, &sectionBlocks[chunkBlockIndex(minX, y % CHUNK_SIZE, z)], maxX - minX + 1);
+					}
+				}
+			}
+		}
+	}
+
+	return schematic;
+}
+
+void World::pasteRegion(const Schematic &schematic, glm::ivec3 pos, 
+						uint32_t rotation, bool mirror, bool pasteAir)
+{
+	if(mirror || rotation % 4 != 0)
+	{
+		Schematic transformed = mirror ? schematic.mirrored() : schematic;
+		pasteRegion(transformed.rotated(rotation), pos, 0, false, pasteAir);
+		return;
+	}
+
+	if(schematic.size.x <= 0 || schematic.size.y <= 0 || schematic.size.z <= 0)
+		return;
+
+	glm::ivec3 minPos = pos,
+			   maxPos = pos + schematic.size - glm::ivec3(1);
+	int32_t minY = std::max(minPos.y, 0),
+			maxY = std::min(maxPos.y, (int32_t)worldHeight - 1);
+	if(minY > maxY)
+		return;
+
+	auto locks = lockChunks(worldToChunkCoord(minPos.x), worldToChunkCoord(minPos.z),
+							worldToChunkCoord(maxPos.x), worldToChunkCoord(maxPos.z));
+	std::lock_guard journalGuard(journalLock);
+
+	uint8_t oldBlocks[SECTION_VOLUME], newBlocks[SECTION_VOLUME];
+	for(int32_t chunkX = worldToChunkCoord(minPos.x); chunkX <= worldToChunkCoord(maxPos.x); chunkX++)
+	{
+		for(int32_t chunkZ = worldToChunkCoord(minPos.z); chunkZ <= worldToChunkCoord(maxPos.z); chunkZ++)
+		{
+			Chunk *chunk = findChunk(chunkX, chunkZ);
+			if(!chunk)
+				continue;
+
+			int32_t minX = std::max(minPos.x - chunkX * CHUNK_SIZE, 0),
+					maxX = std::min(maxPos.x - chunkX * CHUNK_SIZE, CHUNK_SIZE - 1),
+					minZ = std::max(minPos.z - chunkZ * CHUNK_SIZE, 0),
+					maxZ = std::min(maxPos.z - chunkZ * CHUNK_SIZE, CHUNK_SIZE - 1);
+			size_t entityCount = chunk->blockEntities.size();
+
+			//Each section is decoded, overwritten a row at
+			//a time and then packed again in one go
+			for(int32_t sectionY = minY / CHUNK_SIZE; sectionY <= maxY / CHUNK_SIZE; sectionY++)
+			{
+				chunk->getSection(sectionY).getBlocks(oldBlocks);
+				memcpy(newBlocks, oldBlocks, SECTION_VOLUME);
+				int32_t sectionMinY = std::max(minY, sectionY * CHUNK_SIZE),
+						sectionMaxY = std::min(maxY, sectionY * CHUNK_SIZE + CHUNK_SIZE - 1);
+
+				for(int32_t y = sectionMinY; y <= sectionMaxY; y++)
+				{
+					for(int32_t z = minZ; z <= maxZ; z++)
+					{
+						const uint8_t *row = &schematic.blocks[schematic.index(
+							minX + chunkX * CHUNK_SIZE - minPos.x,
+							y - minPos.y,
+							z + chunkZ * CHUNK_SIZE - minPos.z
+						)];
+						uint8_t *out = &newBlocks[chunkBlockIndex(minX, y % CHUNK_SIZE, z)];
+
+						if(pasteAir)
+							memcpy(out, row, maxX - minX + 1);
+						else
+							for(int32_t x = 0; x <= maxX - minX; x++)
+								if(row[x] != AIR)
+									out[x] = row[x];
+
+						for(int32_t x = minX; x <= maxX; x++)
+							journal.record(x + chunkX * CHUNK_SIZE, y, z + chunkZ * CHUNK_SIZE, 
+										   oldBlocks[chunkBlockIndex(x, y % CHUNK_SIZE, z)],
+										   newBlocks[chunkBlockIndex(x, y % CHUNK_SIZE, z)]);
+					}
+				}
+
+				//Only sections that changed are saved and remeshed
+				if(memcmp(oldBlocks, newBlocks, SECTION_VOLUME) == 0)
+					continue;
+				chunk->setSectionBlocks(sectionY, newBlocks);
+				saveSection(chunk, sectionY, newBlocks);
+				glm::ivec3 chunkPos = glm::ivec3(chunkX, 0, chunkZ) * CHUNK_SIZE;
+				markDirty(chunkPos + glm::ivec3(minX, sectionMinY, minZ), chunkPos + glm::ivec3(maxX, sectionMaxY, maxZ));
+			}
+
+			//Entities of blocks that were replaced are gone
+			if(chunk->blockEntities.size() != entityCount)
+				saveBlockEntities(chunk);
+		}
+	}
+
+	commitEdit();
+}
+
+std::vector<std::shared_ptr<const ChunkSnapshot>> World::pinRegion(glm::ivec3 minPos, glm::ivec3 maxPos)
+{
+	std::vector<std::shared_ptr<const ChunkSnapshot>> snapshots;
+	for(int32_t chunkX = worldToChunkCoord(minPos.x); chunkX <= worldToChunkCoord(maxPos.x); chunkX++)
+	{
+		for(int32_t chunkZ = worldToChunkCoord(minPos.z); chunkZ <= worldToChunkCoord(maxPos.z); chunkZ++)
+		{
+			Chunk *chunk = findChunk(chunkX, chunkZ);
+			if(!chunk)
+				continue;
+
+			auto lock = lockChunkShared(chunk);
+			snapshots.push_back(chunk->snapshot());
+		}
+	}
+	return snapshots;
+}
+
+void World::forEachSectionInBox(const std::vector<std::shared_ptr<const ChunkSnapshot>> &snapshots,
+								glm::ivec3 minPos, glm::ivec3 maxPos,
+								const std::function<void(size_t, const ChunkSection&, const SectionBox&, glm::ivec3)> &func)
+{
+	int32_t minY = std::max(minPos.y, 0),
+			maxY = std::min(maxPos.y, (int32_t)worldHeight - 1);
+	if(minY > maxY)
+		return;
+
+	auto visitChunk = [&](size_t i) {
+		const ChunkSnapshot &chunk = *snapshots[i];
+		SectionBox box;
+		box.minX = std::max(minPos.x - chunk.chunkX * CHUNK_SIZE, 0);
+		box.maxX = std::min(maxPos.x - chunk.chunkX * CHUNK_SIZE, CHUNK_SIZE - 1);
+		box.minZ = std::max(minPos.z - chunk.chunkZ * CHUNK_SIZE, 0);
+		box.maxZ = std::min(maxPos.z - chunk.chunkZ * CHUNK_SIZE, CHUNK_SIZE - 1);
+
+		for(int32_t sectionY = minY / CHUNK_SIZE; sectionY <= maxY / CHUNK_SIZE; sectionY++)
+		{
+			box.minY = std::max(minY - sectionY * CHUNK_SIZE, 0);
+			box.maxY = std::min(maxY - sectionY * CHUNK_SIZE, CHUNK_SIZE - 1);
+			func(i, chunk.getSection(sectionY), box, glm::ivec3(chunk.chunkX, sectionY, chunk.chunkZ) * CHUNK_SIZE);
+		}
+	};
+
+	if(snapshots.size() >= QUERY_PARALLEL_CHUNKS)
+		parallelFor(snapshots.size(), visitChunk);
+	else
+		for(size_t i = 0; i < snapshots.size(); i++)
+			visitChunk(i);
+}
+
+BlockHistogram World::blockHistogram(glm::ivec3 pos1, glm::ivec3 pos2)
+{
+	glm::ivec3 minPos = glm::min(pos1, pos2),
+			   maxPos = glm::max(pos1, pos2);
+	auto snapshots = pinRegion(minPos, maxPos);
+
+	//One histogram per chunk so that the threads never share one
+	std::vector<BlockHistogram> histograms(snapshots.size(), BlockHistogram{});
+	forEachSectionInBox(snapshots, minPos, maxPos, 
+		[&histograms](size_t i, const ChunkSection &section, const SectionBox &box, glm::ivec3) {
+			if(section.isUniform())
+			{
+				histograms[i][section.uniformBlock()] += box.volume();
+				return;
+			}
+
+			uint8_t blocks[SECTION_VOLUME];
+			section.getBlocks(blocks);
+			addSectionHistogram(blocks, box, section.getPalette(), histograms[i]);
+		});
+
+	BlockHistogram total{};
+	for(auto &histogram : histograms)
+		for(size_t block = 0; block < total.size(); block++)
+			total[block] += histogram[block];
+	return total;
+}
+
+uint64_t World::countBlocks(glm::ivec3 pos1, glm::ivec3 pos2, uint8_t block)
+{
+	glm::ivec3 minPos = glm::min(pos1, pos2),
+			   maxPos = glm::max(pos1, pos2);
+	auto snapshots = pinRegion(minPos, maxPos);
+
+	std::vector<uint64_t> counts(snapshots.size(), 0);
+	forEachSectionInBox(snapshots, minPos, maxPos, 
+		[&counts, block](size_t i, const ChunkSection &section, const SectionBox &box, glm::ivec3) {
+			if(!section.mayContain(block))
+				return;
+			if(section.isUniform())
+			{
+				counts[i] += box.volume();
+				return;
+			}
 
-World::World(uint32_t size, uint32_t height)
+			uint8_t blocks[SECTION_VOLUME];
+			section.getBlocks(blocks);
+			counts[i] += countInSection(blocks, box, block);
+		});
+
+	uint64_t total = 0;
+	for(auto count : counts)
+		total += count;
+	return total;
+}
+
+std::vector<glm::ivec3> World::findBlocks(glm::ivec3 pos1, glm::ivec3 pos2, uint8_t block)
 {
-	blocks = new uint8_t[size * size * height];	
-	worldSize = size;
-	worldHeight = height;
+	glm::ivec3 minPos = glm::min(pos1, pos2),
+			   maxPos = glm::max(pos1, pos2);
+	auto snapshots = pinRegion(minPos, maxPos);
+
+	std::vector<std::vector<glm::ivec3>> found(snapshots.size());
+	forEachSectionInBox(snapshots, minPos, maxPos, 
+		[&found, block](size_t i, const ChunkSection &section, const SectionBox &box, glm::ivec3 sectionPos) {
+			if(!section.mayContain(block))
+				return;
+
+			uint8_t blocks[SECTION_VOLUME];
+			section.getBlocks(blocks);
+			findInSection(blocks, box, block, sectionPos, found[i]);
+		});
+
+	std::vector<glm::ivec3> positions;
+	for(auto &chunkPositions : found)
+		positions.insert(positions.end(), chunkPositions.begin(), chunkPositions.end());
+	return positions;
+}
 
-	buffers = std::vector<unsigned int>((size / CHUNK_SIZE + 1) * (size / CHUNK_SIZE + 1) * 2);	
-	chunkVertexCount = std::vector<unsigned int>((size / CHUNK_SIZE + 1) * (size / CHUNK_SIZE + 1));
-	chunkVaos = std::vector<unsigned int>((size / CHUNK_SIZE + 1) * (size / CHUNK_SIZE + 1));
+void World::commitEdit()
+{
+	if(editDepth == 0)
+		journal.commit();
+}
 
-	for(int i = 0; i < (size / CHUNK_SIZE + 1) * (size / CHUNK_SIZE + 1); i++)
-		chunkVertexCount[i] = 0;
+void World::beginEdit()
+{
+	std::lock_guard lock(journalLock);
+	editDepth++;
+}
 
-	glGenBuffers(buffers.size(), buffers.data());
-	glGenVertexArrays(chunkVaos.size(), chunkVaos.data());
+void World::endEdit()
+{
+	std::lock_guard lock(journalLock);
+	if(editDepth == 0)
+		return;
+	editDepth--;
+	commitEdit();
 }
 
-World::~World()
+bool World::undo()
 {
-	deleteBuffers();
-	delete[] blocks;
+	//The transaction is copied out so that the journal
+	//is not locked while the chunks are being locked
+	EditTransaction transaction;
+	{
+		std::lock_guard lock(journalLock);
+		if(editDepth > 0)
+			return false;
+		const EditTransaction *last = journal.takeUndo();
+		if(!last)
+			return false;
+		transaction = *last;
+	}
+
+	applyTransaction(transaction, true);
+	return true;
 }
 
-void World::generateWorld()
+bool World::redo()
 {
-	std::cerr << "Building terrain...\n";
+	EditTransaction transaction;
+	{
+		std::lock_guard lock(journalLock);
+		if(editDepth > 0)
+			return false;
+		const EditTransaction *last = journal.takeRedo();
+		if(!last)
+			return false;
+		transaction = *last;
+	}
 
-	std::vector<std::thread> threads;	
+	applyTransaction(transaction, false);
+	return true;
+}
 
-	const float FREQUENCY = 128.0f;
-	const float CAVE_FREQUENCY = 16.0f;
+void World::setUndoLimit(size_t bytes)
+{
+	std::lock_guard lock(journalLock);
+	journal.setLimit(bytes);
+}
 
-	auto generateChunk = [this, &FREQUENCY, &CAVE_FREQUENCY](int32_t chunkX, int32_t chunkZ) {	
+void World::applyTransaction(const EditTransaction &transaction, bool undo)
+{
+	auto locks = lockChunks(worldToChunkCoord(transaction.minPos.x), worldToChunkCoord(transaction.minPos.z),
+							worldToChunkCoord(transaction.maxPos.x), worldToChunkCoord(transaction.maxPos.z));
+
+	//Undo goes through the runs backwards so that a block
+	//changed several times ends up with its oldest value
+	const std::vector<uint8_t> &blocks = undo ? transaction.oldBlocks : transaction.newBlocks;
+	size_t offset = undo ? blocks.size() : 0;
+	for(size_t r = 0; r < transaction.runs.size(); r++)
+	{
+		const EditRun &run = transaction.runs[undo ? transaction.runs.size() - 1 - r : r];
+		if(undo)
+			offset -= run.length;
 
-		// Fill in the world with blocks
-		for(int32_t x = chunkX * CHUNK_SIZE; x < chunkX * CHUNK_SIZE + CHUNK_SIZE; x++)
-		{	
-			for(int32_t z = chunkZ * CHUNK_SIZE; z < chunkZ * CHUNK_SIZE + CHUNK_SIZE; z++)
+		Chunk *chunk = nullptr;
+		int32_t chunkX = 0, chunkZ = worldToChunkCoord(run.z);
+		for(uint32_t i = 0; i < run.length; i++)
+		{
+			//Runs can cross into the next chunk along x
+			int32_t x = run.x + int32_t(i);
+			if(!chunk || worldToChunkCoord(x) != chunkX)
 			{
-				float height = stb_perlin_fbm_noise3(
-					(float)x / FREQUENCY,
-					0.0f,
-					(float)z / FREQUENCY,
-					2.0f,
-					0.5f,
-					4
-				);
-
-				bool negative = height < 0.0f;
-				height *= height;
-				if(negative)
-					height *= -1.25f;
-				else
-					height *= 1.25f;
-
-				height *= 32.0f;
-				height += 64.0f;
-
-				for(int32_t y = 0; y < worldHeight; y++)
-					setBlock(x, y, z, AIR);
-
-				for(int32_t y = 0; y <= (int32_t)height; y++)
-				{			
-					if(y == (int)height)	
-						setBlock(x, y, z, GRASS);
-					else if(y <= (int)height - 1 && 
-							y >= (int)height - 4)
-						setBlock(x, y, z, DIRT);	
-					else if(y < (int)height - 4)
-						setBlock(x, y, z, STONE);
-
-					float cave = stb_perlin_noise3(
-						(float)x / CAVE_FREQUENCY, 
-						(float)y / CAVE_FREQUENCY,
-						(float)z / CAVE_FREQUENCY,
-						0,
-						0,
-						0
-					);
-
-					if(cave < -0.75f + 0.6f * (1.0f - float(y) / float(worldHeight)))
-						setBlock(x, y, z, AIR);
-
-					if(y == 0)
-						setBlock(x, y, z, STONE);	
-				}
+				chunkX = worldToChunkCoord(x);
+				chunk = findChunk(chunkX, chunkZ);
 			}
+			if(!chunk)
+				continue;
+
+			int32_t localX = x - chunkX * CHUNK_SIZE,
+					localZ = run.z - chunkZ * CHUNK_SIZE;
+			size_t entityCount = chunk->blockEntities.size();
+			chunk->setBlock(localX, run.y, localZ, blocks[offset + i]);
+			saveBlock(chunk, localX, run.y, localZ, blocks[offset + i]);
+			if(chunk->blockEntities.size() != entityCount)
+				saveBlockEntities(chunk);
 		}
-	};	
 
-	for(int32_t x = -(int32_t)worldSize / (2 * CHUNK_SIZE); x < (int32_t)worldSize / (2 * CHUNK_SIZE); x++)
-		for(int32_t z = -(int32_t)worldSize / (2 * CHUNK_SIZE); z < (int32_t)worldSize / (2 * CHUNK_SIZE); z++)
-			threads.push_back(std::thread(generateChunk, x, z));
+		//Sections can be marked by several runs,
+		//buildDirtyChunks only rebuilds each of them once
+		markDirty(glm::ivec3(run.x, run.y, run.z), glm::ivec3(run.x + int32_t(run.length) - 1, run.y, run.z));
 
-	for(auto &thread : threads)
-		thread.join();
+		if(!undo)
+			offset += run.length;
+	}
+}
 
-	//Generate trees
-	for(int32_t x = -(int32_t)worldSize / 2; x < (int32_t)worldSize / 2; x++)
-	{
-		for(int32_t z = -(int32_t)worldSize / 2; z < (int32_t)worldSize / 2; z++)
-		{	
-			if(rand() % 1000 == 0)
-			{
-				float height = stb_perlin_fbm_noise3(
-					(float)x / FREQUENCY,
-					0.0f,
-					(float)z / FREQUENCY,
-					2.0f,
-					0.5f,
-					4
-				);
+bool World::isSolid(int32_t x, int32_t y, int32_t z)
+{
+	if(y < 0 || y >= (int32_t)worldHeight)
+		return false;
 
-				bool negative = height < 0.0f;
-				height *= height;
-				if(negative)
-					height *= -1.25f;
-				else
-					height *= 1.25f;
+	int32_t chunkX = worldToChunkCoord(x),
+			chunkZ = worldToChunkCoord(z);
 
-				height *= 32.0f;
-				height += 64.0f;
+	Chunk *chunk = findChunk(chunkX, chunkZ);
+	if(!chunk)
+		return false;
 
-				int y = (int)height;
-				
-				if(getBlock(x, y, z) == GRASS)
-				{
-					int treeHeight = rand() % 4 + 4;
-					for(int i = 1; i <= treeHeight; i++)
-						setBlock(x, y + i, z, LOG);
+	auto lock = lockChunkShared(chunk);
+	return isSolidBlock(chunk->getBlock(x - chunkX * CHUNK_SIZE, y, z - chunkZ * CHUNK_SIZE));
+}
 
-					for(int leafX = x - 2; leafX <= x + 2; leafX++)
-						for(int leafY = y + treeHeight - 2; leafY < y + treeHeight; leafY++)
-							for(int leafZ = z - 2; leafZ <= z + 2; leafZ++)
-								if(getBlock(leafX, leafY, leafZ) == AIR)
-									setBlock(leafX, leafY, leafZ, LEAVES);
-					
-					for(int leafX = x - 1; leafX <= x + 1; leafX++)
-						for(int leafZ = z - 1; leafZ <= z + 1; leafZ++)
-							if(getBlock(leafX, y + treeHeight, leafZ) == AIR)
-								setBlock(leafX, y + treeHeight, leafZ, LEAVES);
-				
-					for(int leafX = x - 1; leafX <= x + 1; leafX++)
-						for(int leafZ = z - 1; leafZ <= z + 1; leafZ++)
-							if(getBlock(leafX, y + treeHeight + 1, leafZ) == AIR &&
-							   (leafX - x) * (leafX - x) + (leafZ - z) * (leafZ - z) <= 1)
-								setBlock(leafX, y + treeHeight + 1, leafZ, LEAVES);
-				}
-			}
-		}
+int32_t World::getHeight(int32_t x, int32_t z)
+{
+	int32_t chunkX = worldToChunkCoord(x),
+			chunkZ = worldToChunkCoord(z);
+
+	//The heightmap is kept while a chunk is cold
+	Chunk *chunk = findChunk(chunkX, chunkZ);
+	if(!chunk)
+		return -1;
+
+	std::shared_lock lock(chunkLocks[chunkLockIndex(chunkX, chunkZ)]);
+	return chunk->getHeight(x - chunkX * CHUNK_SIZE, z - chunkZ * CHUNK_SIZE);
+}
+
+size_t World::blockMemoryUsage()
+{
+	size_t total = 0;
+	for(auto chunk : allChunks())
+	{
+		std::shared_lock lock(chunkLocks[chunkLockIndex(chunk->chunkX, chunk->chunkZ)]);
+		total += chunk->memoryUsage();
 	}
+	return total;
 }
 
-uint8_t World::getBlock(int32_t x, int32_t y, int32_t z)
+size_t World::denseMemoryUsage()
+{
+	std::shared_lock lock(chunkMapLock);
+	return chunks.size() * size_t(CHUNK_SIZE * CHUNK_SIZE) * size_t(worldHeight);
+}
+
+MemoryStats World::memoryStats()
 {
-	int32_t indexX = x + worldSize / 2,
-			indexY = worldHeight - 1 - y,
-			indexZ = z + worldSize / 2;
+	MemoryStats stats;
+	stats.sectionDataReserved = sectionDataReserved();
+	stats.denseBlockBytes = denseMemoryUsage();
+	stats.meshStagingPeak = meshStagingPeak;
+	{
+		std::lock_guard lock(journalLock);
+		stats.undoHistoryBytes = journal.memoryUsage();
+	}
+	{
+		std::shared_lock lock(chunkMapLock);
+		stats.chunkCount = chunks.size();
+		stats.chunkMapBytes = chunks.memoryUsage();
+	}
+	{
+		std::shared_lock lock(fileLock);
+		stats.worldFileBytes = file.mappedSize();
+	}
+
+	for(auto chunk : allChunks())
+	{
+		std::shared_lock lock(chunkLocks[chunkLockIndex(chunk->chunkX, chunk->chunkZ)]);
+		if(chunk->cold)
+			stats.coldChunkCount++;
+
+		size_t blockBytes = chunk->memoryUsage();
+		stats.blockBytes += blockBytes;
+		stats.maxChunkBlockBytes = std::max(stats.maxChunkBlockBytes, blockBytes);
+
+		//5 floats per vertex, uploadSectionMesh fills both buffers with the mesh
+		size_t meshBytes = 0;
+		for(auto &mesh : chunk->meshes)
+			meshBytes += size_t(mesh.vertexCount) * 5 * sizeof(float);
+		stats.maxChunkMeshBytes = std::max(stats.maxChunkMeshBytes, meshBytes);
+		stats.gpuBytes += meshBytes * 2;
+		stats.maxChunkGpuBytes = std::max(stats.maxChunkGpuBytes, meshBytes * 2);
+	}
 
-	if(indexX < 0 || indexY < 0 || indexZ < 0 ||
-	   indexX >= worldSize || indexY >= worldHeight || indexZ >= worldSize)
-		return 0;
+	return stats;
+}
 
-	return blocks[indexY * worldSize * worldSize + indexZ * worldSize + indexX];
+void World::internChunk(Chunk *chunk, SectionTable &table)
+{
+	for(auto &section : chunk->sections)
+		table.intern(section);
 }
 
-void World::setBlock(int32_t x, int32_t y, int32_t z, uint8_t block)
+void World::dedupSections()
 {
-	int32_t indexX = x + worldSize / 2,
-			indexY = worldHeight - 1 - y,
-			indexZ = z + worldSize / 2;
+	SectionTable table;
+	for(auto chunk : allChunks())
+	{
+		//Cold chunks have no sections, they are deduplicated
+		//the next time this runs after they are used
+		std::unique_lock lock(chunkLocks[chunkLockIndex(chunk->chunkX, chunk->chunkZ)]);
+		if(!chunk->cold)
+			internChunk(chunk, table);
+	}
+}
 
-	if(indexX < 0 || indexY < 0 || indexZ < 0 ||
-	   indexX >= worldSize || indexY >= worldHeight || indexZ >= worldSize)
+void World::startDedupSections()
+{
+	if(dedupRunning)
 		return;
+	if(dedupThread.joinable())
+		dedupThread.join();
+
+	dedupRunning = true;
+	dedupThread = std::thread([this]() {
+		dedupSections();
+		dedupRunning = false;
+	});
+}
+
+SectionDedupStats World::sectionDedupStats()
+{
+	SectionDedupStats stats;
+	std::unordered_set<const void*> data;
+	for(auto chunk : allChunks())
+	{
+		std::shared_lock lock(chunkLocks[chunkLockIndex(chunk->chunkX, chunk->chunkZ)]);
+		for(auto &section : chunk->sections)
+		{
+			stats.sections++;
+			if(section.isUniform())
+			{
+				stats.uniformSections++;
+				continue;
+			}
+
+			stats.dataSections++;
+			stats.unsharedBytes += section.dataBytes();
+			if(data.insert(section.dataId()).second)
+				stats.residentBytes += section.dataBytes();
+		}
+	}
+	stats.distinctData = data.size();
+	return stats;
+}
 
-	blocks[indexY * worldSize * worldSize + indexZ * worldSize + indexX] = block;
+double SectionDedupStats::ratio() const
+{
+	return distinctData > 0 ? double(dataSections) / double(distinctData) : 1.0;
+}
+
+void SectionDedupStats::print(std::ostream &out) const
+{
+	const double MIB = 1024.0 * 1024.0;
+	out << "Sections: " << sections << " (" << uniformSections << " uniform, " 
+		<< dataSections << " with data, " << distinctData << " distinct)\n"
+		<< "  Dedup ratio: " << ratio() << '\n'
+		<< "  Section data: " << unsharedBytes / MIB << " MiB without sharing, " 
+		<< residentBytes / MIB << " MiB resident\n";
+}
+
+size_t MemoryStats::total() const
+{
+	return blockBytes + chunkMapBytes + meshStagingPeak + undoHistoryBytes;
+}
+
+void MemoryStats::print(std::ostream &out) const
+{
+	const double MIB = 1024.0 * 1024.0;
+	out << "Memory usage (" << chunkCount << " chunks, " << coldChunkCount << " cold)\n"
+		<< "  Blocks: " << blockBytes / MIB << " MiB (largest chunk: " << maxChunkBlockBytes << " bytes, "
+		<< "one byte per block: " << denseBlockBytes / MIB << " MiB)\n"
+		<< "  Undo history: " << undoHistoryBytes / MIB << " MiB\n"
+		<< "  Section data reserved: " << sectionDataReserved / MIB << " MiB\n"
+		<< "  Chunk map: " << chunkMapBytes / MIB << " MiB\n"
+		<< "  Mesh staging peak: " << meshStagingPeak / MIB << " MiB (largest chunk: " << maxChunkMeshBytes << " bytes)\n"
+		<< "  GPU buffers: " << gpuBytes / MIB << " MiB (largest chunk: " << maxChunkGpuBytes << " bytes)\n"
+		<< "  World file mapped: " << worldFileBytes / MIB << " MiB\n"
+		<< "  Total (system memory): " << total() / MIB << " MiB\n";
 }
 
 void addVertices(std::vector<float> &chunk, 
@@ -204,340 +1801,597 @@ void addVertices(std::vector<float> &chunk,
 	}
 }
 
-void World::addBlockVertices(std::vector<float> &chunk, int32_t x, int32_t y, int32_t z)
+//Corners of each face of a block (2 triangles), in BlockFace order
+static const float FACE_VERTICES[6][18] = {
+	//Right face
+	{
+		WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
+		WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
+		WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
+
+		WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
+		WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
+		WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
+	},
+	//Left face
+	{
+		-WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
+		-WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
+		-WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
+
+		-WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
+		-WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
+		-WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
+	},
+	//Top face
+	{
+		-WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
+		WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
+		-WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,	
+
+		WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
+		WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
+		-WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,	
+	},
+	//Bottom face
+	{
+		-WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
+		WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
+		-WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
+
+		-WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
+		WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
+		WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,	
+	},
+	//Front face
+	{
+		WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
+		-WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
+		-WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
+
+		WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
+		-WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
+		WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,		
+	},
+	//Back face
+	{
+		-WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
+		-WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
+		WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
+
+		WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
+		-WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
+		WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,	
+	},
+};
+
+//Texture coordinates of the corners in FACE_VERTICES
+static const float FACE_TEXTURE_COORDS[6][12] = {
+	//Right face
+	{
+		0.0f, 0.0f,	
+		0.0f, 1.0f,
+		1.0f, 1.0f,
+
+		0.0f, 0.0f,			
+		1.0f, 1.0f,
+		1.0f, 0.0f,	
+	},
+	//Left face
+	{
+		0.0f, 1.0f,
+		1.0f, 1.0f,
+		1.0f, 0.0f,
+
+		0.0f, 0.0f,
+		0.0f, 1.0f,		
+		1.0f, 0.0f,	
+	},
+	//Top face
+	{
+		0.0f, 1.0f,
+		1.0f, 1.0f,
+		0.0f, 0.0f,	
+
+		1.0f, 1.0f,
+		1.0f, 0.0f,
+		0.0f, 0.0f,	
+	},
+	//Bottom face
+	{
+		1.0f, 1.0f,
+		0.0f, 0.0f,
+		1.0f, 0.0f,
+
+		1.0f, 1.0f,
+		0.0f, 1.0f,
+		0.0f, 0.0f,
+	},
+	//Front face
+	{
+		1.0f, 0.0f,
+		0.0f, 0.0f,
+		0.0f, 1.0f,
+
+		1.0f, 0.0f,
+		0.0f, 1.0f,
+		1.0f, 1.0f,
+	},
+	//Back face
+	{
+		1.0f, 1.0f,
+		1.0f, 0.0f,
+		0.0f, 0.0f,
+
+		0.0f, 1.0f,	
+		1.0f, 1.0f,
+		0.0f, 0.0f,
+	},
+};
+
+//Offset in a BlockView to the neighbor on each side of a block
+static const int32_t FACE_NEIGHBOR_OFFSETS[6] = {
+	BlockView::STRIDE_X, -BlockView::STRIDE_X,
+	BlockView::STRIDE_Y, -BlockView::STRIDE_Y,
+	BlockView::STRIDE_Z, -BlockView::STRIDE_Z,
+};
+
+void World::addBlockVertices(std::vector<float> &chunk, 
+							 const BlockView &view, 
+							 int32_t localX,
+							 int32_t localY,
+							 int32_t localZ,
+							 glm::ivec3 sectionPos)
 {
-	if(getBlock(x, y, z) == AIR)
+	int32_t i = BlockView::index(localX, localY, localZ);
+	uint8_t block = view.blocks[i];
+	if(block == AIR)
 		return;
 
-	if(getBlock(x + 1, y, z) == AIR)
-	{
-		//Right face	
-		const float rightFace[] = {
-			WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
-			WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
-			WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
-
-			WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
-			WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
-			WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
-		};
-
-		const float rightFaceTexture[] = {
-			0.0f, 0.0f,	
-			0.0f, 1.0f,
-			1.0f, 1.0f,
-
-			0.0f, 0.0f,			
-			1.0f, 1.0f,
-			1.0f, 0.0f,	
-		};
-
-		if(getBlock(x, y, z) == LOG)	
-			addVertices(chunk, rightFace, rightFaceTexture, x, y, z, getBlock(x, y, z) - 1);
-		else if(getBlock(x, y, z) == GRASS)
-			addVertices(chunk, rightFace, rightFaceTexture, x, y, z, getBlock(x, y, z) + TEXTURE_ATLAS_SIZE);
-		else
-			addVertices(chunk, rightFace, rightFaceTexture, x, y, z, getBlock(x, y, z));
-	}
-
-	if(getBlock(x - 1, y, z) == AIR)
-	{
-		//Left face	
-		const float leftFace[] = {
-			-WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
-			-WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
-			-WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
-
-			-WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
-			-WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
-			-WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
-		};
-
-		const float leftFaceTexture[] = {
-			0.0f, 1.0f,
-			1.0f, 1.0f,
-			1.0f, 0.0f,
-	
-			0.0f, 0.0f,
-			0.0f, 1.0f,		
-			1.0f, 0.0f,	
-		};
-
-		if(getBlock(x, y, z) == LOG)	
-			addVertices(chunk, leftFace, leftFaceTexture, x, y, z, getBlock(x, y, z) - 1);
-		else if(getBlock(x, y, z) == GRASS)
-			addVertices(chunk, leftFace, leftFaceTexture, x, y, z, getBlock(x, y, z) + TEXTURE_ATLAS_SIZE);
-		else
-			addVertices(chunk, leftFace, leftFaceTexture, x, y, z, getBlock(x, y, z));
-	}
-
-	if(getBlock(x, y + 1, z) == AIR)
-	{
-		//Top face
-		const float topFace[] = {
-			-WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
-			WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
-			-WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,	
-
-			WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
-			WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
-			-WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,	
-		};
-
-		const float topFaceTexture[] = {
-			0.0f, 1.0f,
-			1.0f, 1.0f,
-			0.0f, 0.0f,	
-
-			1.0f, 1.0f,
-			1.0f, 0.0f,
-			0.0f, 0.0f,	
-		};
-
-		addVertices(chunk, topFace, topFaceTexture, x, y, z, getBlock(x, y, z));
-	}
-
-	if(getBlock(x, y - 1, z) == AIR)
-	{
-		//Bottom face
-		const float bottomFace[] = {
-			-WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
-			WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
-			-WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
-
-			-WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
-			WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
-			WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,	
-		};
-
-		const float bottomFaceTexture[] = {
-			1.0f, 1.0f,
-			0.0f, 0.0f,
-			1.0f, 0.0f,
-
-			1.0f, 1.0f,
-			0.0f, 1.0f,
-			0.0f, 0.0f,
-		};
-
-		if(getBlock(x, y, z) == GRASS)	
-			addVertices(chunk, bottomFace, bottomFaceTexture, x, y, z, getBlock(x, y, z) + 1);
-		else
-			addVertices(chunk, bottomFace, bottomFaceTexture, x, y, z, getBlock(x, y, z));
-	}
-
-	if(getBlock(x, y, z + 1) == AIR)
-	{				
-		//Front face
-		const float frontFace[] = {
-			WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
-			-WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
-			-WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
-
-			WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
-			-WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,
-			WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f,		
-		};
-
-		const float frontFaceTexture[] = {
-			1.0f, 0.0f,
-			0.0f, 0.0f,
-			0.0f, 1.0f,
-
-			1.0f, 0.0f,
-			0.0f, 1.0f,
-			1.0f, 1.0f,
-		};
-
-		addVertices(chunk, frontFace, frontFaceTexture, x, y, z, getBlock(x, y, z));
-	
-		if(getBlock(x, y, z) == LOG)	
-			addVertices(chunk, frontFace, frontFaceTexture, x, y, z, getBlock(x, y, z) - 1);
-		else if(getBlock(x, y, z) == GRASS)
-			addVertices(chunk, frontFace, frontFaceTexture, x, y, z, getBlock(x, y, z) + TEXTURE_ATLAS_SIZE);
-		else
-			addVertices(chunk, frontFace, frontFaceTexture, x, y, z, getBlock(x, y, z));
-	}
-
-	if(getBlock(x, y, z - 1) == AIR)
-	{
-		//Back face
-		const float backFace[] = {
-			-WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
-			-WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
-			WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
-
-			WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
-			-WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,
-			WORLD_SCALE / 2.0f, WORLD_SCALE / 2.0f, -WORLD_SCALE / 2.0f,	
-		};
-
-		const float backFaceTexture[] = {
-			1.0f, 1.0f,
-			1.0f, 0.0f,
-			0.0f, 0.0f,
-
-			0.0f, 1.0f,	
-			1.0f, 1.0f,
-			0.0f, 0.0f,
-		};	
-
-		if(getBlock(x, y, z) == LOG)	
-			addVertices(chunk, backFace, backFaceTexture, x, y, z, getBlock(x, y, z) - 1);
-		else if(getBlock(x, y, z) == GRASS)
-			addVertices(chunk, backFace, backFaceTexture, x, y, z, getBlock(x, y, z) + TEXTURE_ATLAS_SIZE);
-		else
-			addVertices(chunk, backFace, backFaceTexture, x, y, z, getBlock(x, y, z));	
+	int32_t x = sectionPos.x + localX,
+			y = sectionPos.y + localY,
+			z = sectionPos.z + localZ;
+
+	for(int face = 0; face < 6; face++)
+		if(!isOpaqueBlock(view.blocks[i + FACE_NEIGHBOR_OFFSETS[face]]))
+			addVertices(chunk, FACE_VERTICES[face], FACE_TEXTURE_COORDS[face], x, y, z, blockTexture(block, BlockFace(face)));
+}
+
+const ChunkSection* ChunkNeighborhood::getSection(int32_t dx, int32_t sectionY, int32_t dz) const
+{
+	const ChunkSnapshot *chunk = chunks[(dz + 1) * 3 + (dx + 1)].get();
+	if(!chunk || sectionY < 0 || sectionY >= (int32_t)chunk->sections.size())
+		return nullptr;
+	return &chunk->sections[sectionY];
+}
+
+ChunkNeighborhood World::pinNeighborhood(int32_t chunkX, int32_t chunkZ,
+										 PinnedSnapshots &pinned)
+{
+	Chunk *center = findChunk(chunkX, chunkZ);
+	ChunkNeighborhood neighborhood;
+	for(int32_t dz = -1; dz <= 1; dz++)
+	{
+		for(int32_t dx = -1; dx <= 1; dx++)
+		{
+			auto &snapshot = pinned[{ chunkX + dx, chunkZ + dz }];
+			//Only chunks next to a missing chunk have to be looked up
+			Chunk *chunk = center ? center->neighbor(dx, dz) : findChunk(chunkX + dx, chunkZ + dz);
+			if(!snapshot && chunk)
+			{
+				auto lock = lockChunkShared(chunk);
+				snapshot = chunk->snapshot();
+			}
+			neighborhood.chunks[(dz + 1) * 3 + (dx + 1)] = snapshot;
+		}
+	}
+	return neighborhood;
+}
+
+bool World::sectionCanHaveFaces(const ChunkNeighborhood &neighborhood, int32_t sectionY)
+{
+	const ChunkSection *section = neighborhood.getSection(0, sectionY, 0);
+	if(!section)
+		return false;
+	if(!section->isUniform())
+		return true;
+	if(!isDrawnBlock(section->uniformBlock()))
+		return false;
+	//The faces between transparent blocks are drawn
+	if(!isOpaqueBlock(section->uniformBlock()))
+		return true;
+
+	//A section that is completely opaque can only have faces
+	//if one of its neighbors is not completely opaque
+	const int32_t offsets[6][3] = {
+		{ 1, 0, 0 }, { -1, 0, 0 },
+		{ 0, 1, 0 }, { 0, -1, 0 },
+		{ 0, 0, 1 }, { 0, 0, -1 },
+	};
+
+	for(int i = 0; i < 6; i++)
+	{
+		const ChunkSection *neighbor = neighborhood.getSection(
+			offsets[i][0], 
+			sectionY + offsets[i][1],
+			offsets[i][2]
+		);
+
+		if(!neighbor || !neighbor->isUniform() || !isOpaqueBlock(neighbor->uniformBlock()))
+			return true;
 	}
+
+	return false;
 }
 
-void World::buildChunk(int32_t chunkX, int32_t chunkZ)
+void World::fillBlockView(BlockView &view, int32_t chunkX, int32_t sectionY, int32_t chunkZ)
+{
+	PinnedSnapshots pinned;
+	fillBlockView(view, pinNeighborhood(chunkX, chunkZ, pinned), sectionY);
+}
+
+void World::fillBlockView(BlockView &view, const ChunkNeighborhood &neighborhood, int32_t sectionY)
+{
+	//Sections surrounding the section, indexed by
+	//(dy + 1) * 9 + (dz + 1) * 3 + (dx + 1)
+	const ChunkSection *neighbors[27];
+	for(int32_t dy = -1; dy <= 1; dy++)
+		for(int32_t dz = -1; dz <= 1; dz++)
+			for(int32_t dx = -1; dx <= 1; dx++)
+				neighbors[(dy + 1) * 9 + (dz + 1) * 3 + (dx + 1)] = 
+					neighborhood.getSection(dx, sectionY + dy, dz);
+
+	//Copy the section itself row by row
+	uint8_t sectionBlocks[SECTION_VOLUME];
+	const ChunkSection *center = neighbors[13];
+	if(center)
+		center->getBlocks(sectionBlocks);
+	else
+		memset(sectionBlocks, AIR, SECTION_VOLUME);
+
+	for(int32_t y = 0; y < CHUNK_SIZE; y++)
+		for(int32_t z = 0; z < CHUNK_SIZE; z++)
+			memcpy(&view.blocks[BlockView::index(0, y, z)], 
+				   &sectionBlocks[chunkBlockIndex(0, y, z)],
+				   CHUNK_SIZE);
+
+	//Fill in the halo from the neighboring sections
+	for(int32_t y = -1; y <= CHUNK_SIZE; y++)
+	{
+		for(int32_t z = -1; z <= CHUNK_SIZE; z++)
+		{
+			for(int32_t x = -1; x <= CHUNK_SIZE; x++)
+			{
+				int32_t dx = x < 0 ? -1 : (x >= CHUNK_SIZE ? 1 : 0),
+						dy = y < 0 ? -1 : (y >= CHUNK_SIZE ? 1 : 0),
+						dz = z < 0 ? -1 : (z >= CHUNK_SIZE ? 1 : 0);
+
+				if(dx == 0 && dy == 0 && dz == 0)
+				{
+					//Skip over the inside of the section
+					x = CHUNK_SIZE - 1;
+					continue;
+				}
+
+				const ChunkSection *section = neighbors[(dy + 1) * 9 + (dz + 1) * 3 + (dx + 1)];
+				view.blocks[BlockView::index(x, y, z)] = section ? 
+					section->getBlock(x - dx * CHUNK_SIZE, y - dy * CHUNK_SIZE, z - dz * CHUNK_SIZE) :
+					uint8_t(AIR);
+			}
+		}
+	}
+}
+
+void World::getVisibleFaces(int32_t chunkX, 
+							int32_t sectionY,
+							int32_t chunkZ,
+							uint64_t faces[6][OCCUPANCY_WORDS])
 {
-	int32_t index = ((chunkX + worldSize / (2 * CHUNK_SIZE)) * (worldSize / CHUNK_SIZE + 1) +
-					 (chunkZ + worldSize / (2 * CHUNK_SIZE)));
+	PinnedSnapshots pinned;
+	getVisibleFaces(pinNeighborhood(chunkX, chunkZ, pinned), sectionY, faces);
+}
+
+void World::getVisibleFaces(const ChunkNeighborhood &neighborhood, 
+							int32_t sectionY,
+							uint64_t faces[6][OCCUPANCY_WORDS])
+{
+	const ChunkSection *center = neighborhood.getSection(0, sectionY, 0),
+					   *right = neighborhood.getSection(1, sectionY, 0),
+					   *left = neighborhood.getSection(-1, sectionY, 0),
+					   *top = neighborhood.getSection(0, sectionY + 1, 0),
+					   *bottom = neighborhood.getSection(0, sectionY - 1, 0),
+					   *front = neighborhood.getSection(0, sectionY, 1),
+					   *back = neighborhood.getSection(0, sectionY, -1);
+
+	auto occupancy = [](const ChunkSection *section, uint32_t word) {
+		return section ? section->getOccupancy(word) : 0;
+	};
 
-	//Bounds check
-	if(chunkX < -int32_t(worldSize) / (2 * CHUNK_SIZE) || chunkZ < -int32_t(worldSize) / (2 * CHUNK_SIZE) ||
-	   chunkX >= int32_t(worldSize) / (2 * CHUNK_SIZE) || chunkZ >= int32_t(worldSize) / (2 * CHUNK_SIZE))
+	//Each word holds 4 rows of 16 blocks, these select
+	//the first and last block in each row
+	const uint64_t ROW_START = 0x0001000100010001ull;
+	const uint64_t ROW_END = ROW_START << (CHUNK_SIZE - 1);
+	//Words per y layer
+	const uint32_t LAYER_WORDS = OCCUPANCY_WORDS / CHUNK_SIZE;
+
+	//Sections without transparent blocks draw the opaque ones
+	bool decodeDrawn = center && center->mayContainTransparent();
+
+	for(uint32_t w = 0; w < OCCUPANCY_WORDS; w++)
+	{
+		uint64_t solid = occupancy(center, w),
+				 drawn = decodeDrawn ? center->getDrawn(w) : solid;
+		uint32_t y = w / LAYER_WORDS, 
+				 row = w % LAYER_WORDS;
+
+		//Shift the neighbors of each block into the block's bit
+		uint64_t rightSolid = ((solid >> 1) & ~ROW_END) | 
+							  ((occupancy(right, w) & ROW_START) << (CHUNK_SIZE - 1));
+		uint64_t leftSolid = ((solid << 1) & ~ROW_START) |
+							 ((occupancy(left, w) & ROW_END) >> (CHUNK_SIZE - 1));
+
+		uint64_t nextRows = row < LAYER_WORDS - 1 ? occupancy(center, w + 1) : occupancy(front, y * LAYER_WORDS);
+		uint64_t prevRows = row > 0 ? occupancy(center, w - 1) : occupancy(back, y * LAYER_WORDS + LAYER_WORDS - 1);
+		uint64_t frontSolid = (solid >> CHUNK_SIZE) | (nextRows << (64 - CHUNK_SIZE));
+		uint64_t backSolid = (solid << CHUNK_SIZE) | (prevRows >> (64 - CHUNK_SIZE));
+
+		uint64_t topSolid = y < CHUNK_SIZE - 1 ? occupancy(center, w + LAYER_WORDS) : occupancy(top, row);
+		uint64_t bottomSolid = y > 0 ? occupancy(center, w - LAYER_WORDS) : 
+									   occupancy(bottom, (CHUNK_SIZE - 1) * LAYER_WORDS + row);
+
+		faces[RIGHT_FACE][w] = drawn & ~rightSolid;
+		faces[LEFT_FACE][w] = drawn & ~leftSolid;
+		faces[TOP_FACE][w] = drawn & ~topSolid;
+		faces[BOTTOM_FACE][w] = drawn & ~bottomSolid;
+		faces[FRONT_FACE][w] = drawn & ~frontSolid;
+		faces[BACK_FACE][w] = drawn & ~backSolid;
+	}
+}
+
+void World::addSectionVertices(std::vector<float> &vertices, const ChunkNeighborhood &neighborhood, int32_t sectionY)
+{
+	const ChunkSnapshot *column = neighborhood.chunks[4].get();
+	//Nothing above the highest block in the chunk can have faces
+	if(!column || sectionY * CHUNK_SIZE > column->maxHeight || !sectionCanHaveFaces(neighborhood, sectionY))
 		return;
 
-	std::cerr << "Building chunk: " << chunkX << ", " << chunkZ << '\n';
+	BlockView view;
+	uint64_t faces[6][OCCUPANCY_WORDS];
+	getVisibleFaces(neighborhood, sectionY, faces);
+	fillBlockView(view, neighborhood, sectionY);
 
-	std::vector<float> chunk;
+	glm::ivec3 sectionPos = glm::ivec3(column->chunkX, sectionY, column->chunkZ) * CHUNK_SIZE;
 
-	int32_t worldChunkX = chunkX * CHUNK_SIZE,
-			worldChunkZ = chunkZ * CHUNK_SIZE;
+	//Only visit blocks that have at least one visible face,
+	//in the same order that the blocks are stored in
+	for(uint32_t w = 0; w < OCCUPANCY_WORDS; w++)
+	{
+		uint64_t visible = faces[RIGHT_FACE][w] | faces[LEFT_FACE][w] |
+						   faces[TOP_FACE][w] | faces[BOTTOM_FACE][w] |
+						   faces[FRONT_FACE][w] | faces[BACK_FACE][w];
 
-	for(int32_t x = worldChunkX; x < worldChunkX + CHUNK_SIZE; x++)
-		for(int32_t y = 0; y < worldHeight; y++)
-			for(int32_t z = worldChunkZ; z < worldChunkZ + CHUNK_SIZE; z++)
-				addBlockVertices(chunk, x, y, z);
+		while(visible)
+		{
+			uint32_t i = w * 64 + __builtin_ctzll(visible);
+			visible &= visible - 1;
+
+			addBlockVertices(vertices, view,
+							 i % CHUNK_SIZE,
+							 i / (CHUNK_SIZE * CHUNK_SIZE),
+							 (i / CHUNK_SIZE) % CHUNK_SIZE,
+							 sectionPos);
+		}
+	}
+}
 
+void World::uploadSectionMesh(SectionMesh &mesh, const std::vector<float> &vertices)
+{
 	// 5 values per vertex
 	// (x, y, z) (textureX, textureY)
-	chunkVertexCount.at(index) = chunk.size() / 5;				
+	mesh.vertexCount = vertices.size() / 5;
+
+	//Most sections are sky or buried and never need any buffers
+	if(mesh.vao == 0 && vertices.empty())
+		return;
 
-	glBindVertexArray(chunkVaos.at(index));
-	glBindBuffer(GL_ARRAY_BUFFER, buffers.at(index * 2));			
+	if(mesh.vao == 0)
+	{
+		glGenVertexArrays(1, &mesh.vao);
+		glGenBuffers(2, mesh.buffers);
+	}
+
+	glBindVertexArray(mesh.vao);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.buffers[0]);			
 	glBufferData(GL_ARRAY_BUFFER, 
-		 chunk.size() * sizeof(float), 
-		 chunk.data(),
+		 vertices.size() * sizeof(float), 
+		 vertices.data(),
 		 GL_STATIC_DRAW);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 5, (void*)0);
 	glEnableVertexAttribArray(0);			
 
-	glBindBuffer(GL_ARRAY_BUFFER, buffers.at(index * 2 + 1));	
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.buffers[1]);	
 	glBufferData(GL_ARRAY_BUFFER, 
-		 chunk.size() * sizeof(float), 
-		 chunk.data(),
+		 vertices.size() * sizeof(float), 
+		 vertices.data(),
 		 GL_STATIC_DRAW);
 	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 5, (void*)(sizeof(float) * 3));
 	glEnableVertexAttribArray(1);
 }
 
-ChunkMesh World::createChunkMesh(int32_t chunkX, int32_t chunkZ)
+void World::buildSections(std::vector<glm::ivec3> sectionCoords)
 {
-	int32_t index = ((chunkX + worldSize / (2 * CHUNK_SIZE)) * (worldSize / CHUNK_SIZE + 1) +
-					 (chunkZ + worldSize / (2 * CHUNK_SIZE)));
-
-	//Bounds check
-	if(chunkX < -int32_t(worldSize) / (2 * CHUNK_SIZE) || chunkZ < -int32_t(worldSize) / (2 * CHUNK_SIZE) ||
-	   chunkX >= int32_t(worldSize) / (2 * CHUNK_SIZE) || chunkZ >= int32_t(worldSize) / (2 * CHUNK_SIZE))
-		return { {}, -1 };
+	//Sections of the same chunk end up next to each other
+	//so the chunk's snapshots are reused within a batch
+	std::sort(sectionCoords.begin(), sectionCoords.end(), [](glm::ivec3 a, glm::ivec3 b) {
+		return std::tie(a.x, a.z, a.y) < std::tie(b.x, b.z, b.y);
+	});
+	sectionCoords.erase(std::unique(sectionCoords.begin(), sectionCoords.end()), sectionCoords.end());
+
+	for(size_t batch = 0; batch < sectionCoords.size(); batch += MESH_BATCH_SIZE)
+	{
+		size_t batchSize = std::min(MESH_BATCH_SIZE, sectionCoords.size() - batch);
+		std::vector<ChunkMesh> sectionMeshes(batchSize);
+
+		//Snapshots are taken here so that the workers
+		//never read the chunks themselves
+		std::vector<ChunkNeighborhood> neighborhoods(batchSize);
+		PinnedSnapshots pinned;
+		//Edits made after this are newer than the meshes, even
+		//if the snapshots end up including some of them
+		uint64_t version;
+		{
+			std::lock_guard lock(dirtyLock);
+			version = editVersion;
+		}
+		for(size_t i = 0; i < batchSize; i++)
+		{
+			glm::ivec3 coord = sectionCoords[batch + i];
+			sectionMeshes[i].chunk = findChunk(coord.x, coord.z);
+			sectionMeshes[i].sectionY = coord.y;
+			sectionMeshes[i].version = version;
+			//Sections of the same chunk share its neighborhood
+			if(i > 0 && sectionMeshes[i].chunk == sectionMeshes[i - 1].chunk)
+				neighborhoods[i] = neighborhoods[i - 1];
+			else if(sectionMeshes[i].chunk)
+				neighborhoods[i] = pinNeighborhood(coord.x, coord.z, pinned);
+		}
 
-	std::vector<float> chunk;
+		parallelFor(batchSize, [this, &sectionMeshes, &neighborhoods](size_t i) {
+			if(sectionMeshes[i].chunk)
+				addSectionVertices(sectionMeshes[i].vertices, neighborhoods[i], sectionMeshes[i].sectionY);
+		});
 
-	int32_t worldChunkX = chunkX * CHUNK_SIZE,
-			worldChunkZ = chunkZ * CHUNK_SIZE;
+		size_t stagingBytes = 0;
+		for(auto &mesh : sectionMeshes)
+			stagingBytes += mesh.vertices.capacity() * sizeof(float);
+		meshStagingPeak = std::max(meshStagingPeak, stagingBytes);
 
-	for(int32_t x = worldChunkX; x < worldChunkX + CHUNK_SIZE; x++)
-		for(int32_t y = 0; y < worldHeight; y++)
-			for(int32_t z = worldChunkZ; z < worldChunkZ + CHUNK_SIZE; z++)
-				addBlockVertices(chunk, x, y, z);	
-	
-	// 5 values per vertex
-	// (x, y, z) (textureX, textureY)
-	chunkVertexCount.at(index) = chunk.size() / 5;
+		for(auto &mesh : sectionMeshes)
+		{
+			if(!mesh.chunk)
+				continue;
 
-	return { chunk, index };
+			std::vector<SectionMesh> &chunkMeshes = mesh.chunk->meshes;
+			if(mesh.sectionY >= (int32_t)chunkMeshes.size())
+				chunkMeshes.resize(mesh.sectionY + 1);
+			//The section was rebuilt from newer snapshots in the meantime
+			if(mesh.version < chunkMeshes[mesh.sectionY].meshVersion)
+				continue;
+			chunkMeshes[mesh.sectionY].meshVersion = mesh.version;
+			uploadSectionMesh(chunkMeshes[mesh.sectionY], mesh.vertices);
+		}
+	}
 }
 
-void World::buildAllChunks()
+void World::buildChunks(const std::vector<std::pair<int32_t, int32_t>> &chunkCoords)
 {
-	std::cerr << "Building all chunks...\n";	
+	std::vector<glm::ivec3> sectionCoords;
+	for(auto [chunkX, chunkZ] : chunkCoords)
+	{
+		Chunk *chunk = findChunk(chunkX, chunkZ);
+		if(!chunk)
+			continue;
 
-	std::vector<std::thread> threads;
-	std::vector<ChunkMesh> chunkMeshes(chunkVaos.size());
+		//The heightmap is kept while the chunk is cold, so it stays cold
+		int32_t topSection;
+		{
+			std::shared_lock lock(chunkLocks[chunkLockIndex(chunkX, chunkZ)]);
+			topSection = std::max(chunk->maxHeight(), 0) / CHUNK_SIZE;
+		}
+		//Sections above that may still have a mesh from before they were emptied
+		topSection = std::max(topSection, (int32_t)chunk->meshes.size() - 1);
 
-	auto buildChunkFunc = [this, &chunkMeshes](int32_t chunkX, int32_t chunkZ)
-	{
-		ChunkMesh chunk = createChunkMesh(chunkX, chunkZ);
-		chunkMeshes.at(chunk.index) = chunk;
-	};
+		for(int32_t sectionY = 0; sectionY <= topSection; sectionY++)
+			sectionCoords.push_back(glm::ivec3(chunkX, sectionY, chunkZ));
+	}
+	buildSections(std::move(sectionCoords));
+}
 
-	for(int32_t x = -(int32_t)worldSize / (2 * CHUNK_SIZE); x < (int32_t)worldSize / (2 * CHUNK_SIZE); x++)
-		for(int32_t z = -(int32_t)worldSize / (2 * CHUNK_SIZE); z < (int32_t)worldSize / (2 * CHUNK_SIZE); z++)
-			threads.push_back(std::thread(buildChunkFunc, x, z));
+void World::buildChunk(int32_t chunkX, int32_t chunkZ)
+{
+	std::cerr << "Building chunk: " << chunkX << ", " << chunkZ << '\n';
+	buildChunks({ { chunkX, chunkZ } });
+}
 
-	for(auto &thread : threads)
-		thread.join();
+void World::buildAllChunks()
+{
+	std::cerr << "Building all chunks...\n";	
 
-	for(auto &mesh : chunkMeshes)
-	{
-		if(mesh.index < 0)
-			continue;
+	std::vector<std::pair<int32_t, int32_t>> chunkCoords;
+	for(auto chunk : allChunks())
+		chunkCoords.push_back({ chunk->chunkX, chunk->chunkZ });
+	buildChunks(chunkCoords);
+}
 
-		glBindVertexArray(chunkVaos.at(mesh.index));
-		glBindBuffer(GL_ARRAY_BUFFER, buffers.at(mesh.index * 2));			
-		glBufferData(GL_ARRAY_BUFFER, 
-			 mesh.vertices.size() * sizeof(float), 
-			 mesh.vertices.data(),
-			 GL_STATIC_DRAW);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 5, (void*)0);
-		glEnableVertexAttribArray(0);			
+void World::buildDirtyChunks()
+{
+	std::vector<glm::ivec3> dirty;
+	{
+		std::lock_guard lock(dirtyLock);
+		if(dirtySections.empty())
+			return;
 
-		glBindBuffer(GL_ARRAY_BUFFER, buffers.at(mesh.index * 2 + 1));	
-		glBufferData(GL_ARRAY_BUFFER, 
-			 mesh.vertices.size() * sizeof(float), 
-			 mesh.vertices.data(),
-			 GL_STATIC_DRAW);
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 5, (void*)(sizeof(float) * 3));
-		glEnableVertexAttribArray(1);
+		for(auto &[coord, version] : dirtySections)
+		{
+			Chunk *chunk = findChunk(coord.x, coord.z);
+			if(!chunk)
+				continue;
+			//Skip sections that have been rebuilt since the edit
+			if(coord.y >= (int32_t)chunk->meshes.size() || 
+			   version > chunk->meshes[coord.y].meshVersion)
+				dirty.push_back(coord);
+		}
+		dirtySections.clear();
 	}
+
+	buildSections(std::move(dirty));
 }
 
 int World::displayWorld(Frustum viewFrustum, glm::vec3 camPos, uint32_t renderDist)
 {
 	int triangleCount = 0;
 
-	for(int32_t x = -(int32_t)worldSize / (2 * CHUNK_SIZE); x < (int32_t)worldSize / (2 * CHUNK_SIZE); x++)
+	glm::vec3 camBlockPos = camPos / WORLD_SCALE;
+	int32_t camChunkX = worldToChunkCoord((int32_t)floorf(camBlockPos.x)),
+			camChunkZ = worldToChunkCoord((int32_t)floorf(camBlockPos.z));
+
+	for(int32_t x = camChunkX - (int32_t)renderDist - 1; x <= camChunkX + (int32_t)renderDist + 1; x++)
 	{
-		for(int32_t z = -(int32_t)worldSize / (2 * CHUNK_SIZE); z < (int32_t)worldSize / (2 * CHUNK_SIZE); z++)
+		for(int32_t z = camChunkZ - (int32_t)renderDist - 1; z <= camChunkZ + (int32_t)renderDist + 1; z++)
 		{
-			Hitbox chunkBoundingBox = Hitbox(
-				glm::vec3(
-					float(x) * CHUNK_SIZE + CHUNK_SIZE / 2.0f,
-					worldHeight / 2.0f,
-					float(z) * CHUNK_SIZE + CHUNK_SIZE / 2.0f
-				),
-				glm::vec3(CHUNK_SIZE, worldHeight, CHUNK_SIZE)
-			);
-
-			uint32_t distX = uint32_t(fabs((chunkBoundingBox.position.x - camPos.x / WORLD_SCALE) / CHUNK_SIZE)),
-					 distZ = uint32_t(fabs((chunkBoundingBox.position.z - camPos.z / WORLD_SCALE) / CHUNK_SIZE));
-			if(distX > renderDist || distZ > renderDist)
-				continue;
-			
-			if(!hitboxIntersectsFrustum(viewFrustum, chunkBoundingBox))
+			//Drawing does not need the blocks, so cold chunks stay cold
+			Chunk *chunk = findChunk(x, z);
+			if(!chunk)
 				continue;
 
-			uint32_t index = ((x + worldSize / (2 * CHUNK_SIZE)) * (worldSize / CHUNK_SIZE + 1) +
-					 (z + worldSize / (2 * CHUNK_SIZE)));		
-			
-			glBindVertexArray(chunkVaos.at(index));
-			glDrawArrays(GL_TRIANGLES, 0, chunkVertexCount.at(index));
+			//Every section is culled on its own, so the sky and the
+			//ground far above or below the camera are never drawn
+			for(int32_t sectionY = 0; sectionY < (int32_t)chunk->meshes.size(); sectionY++)
+			{
+				const SectionMesh &mesh = chunk->meshes[sectionY];
+				if(mesh.vertexCount == 0)
+					continue;
+
+				Hitbox sectionBoundingBox = Hitbox(
+					(glm::vec3(x, sectionY, z) + glm::vec3(0.5f)) * float(CHUNK_SIZE),
+					glm::vec3(CHUNK_SIZE)
+				);
+
+				glm::vec3 offset = (sectionBoundingBox.position - camBlockPos) / float(CHUNK_SIZE);
+				uint32_t distX = uint32_t(fabs(offset.x)),
+						 distY = uint32_t(fabs(offset.y)),
+						 distZ = uint32_t(fabs(offset.z));
+				if(distX > renderDist || distY > renderDist || distZ > renderDist)
+					continue;
 
-			triangleCount += chunkVertexCount.at(index) / 3;
+				if(!hitboxIntersectsFrustum(viewFrustum, sectionBoundingBox))
+					continue;
+
+				glBindVertexArray(mesh.vao);
+				glDrawArrays(GL_TRIANGLES, 0, mesh.vertexCount);
+
+				triangleCount += mesh.vertexCount / 3;
+			}
 		}
 	}
 
@@ -552,10 +2406,10 @@ glm::vec3 raycast(World &world, glm::vec3 start, float yaw, float pitch, float m
 
 	while(glm::length(currentPos - start) < maxdist)
 	{
-		if(world.getBlock(
+		if(world.isSolid(
 				(int32_t)floorf(currentPos.x), 
 				(int32_t)floorf(currentPos.y), 
-				(int32_t)floorf(currentPos.z)) != AIR)
+				(int32_t)floorf(currentPos.z)))
 		{
 			return currentPos;
 		}
@@ -570,16 +2424,17 @@ glm::vec3 raycast(World &world, glm::vec3 start, float yaw, float pitch, float m
 
 void World::deleteBuffers()
 {
-	if(buffers.size() != 0)
+	for(auto chunk : allChunks())
 	{
-		glDeleteBuffers(buffers.size(), buffers.data());
-		buffers.clear();
-	}
+		for(auto &mesh : chunk->meshes)
+		{
+			if(mesh.vao == 0)
+				continue;
 
-	if(chunkVaos.size() != 0)
-	{
-		glDeleteVertexArrays(chunkVaos.size(), chunkVaos.data());
-		chunkVaos.clear();
+			glDeleteBuffers(2, mesh.buffers);
+			glDeleteVertexArrays(1, &mesh.vao);
+		}
+		chunk->meshes.clear();
 	}
 }
 
@@ -606,7 +2461,7 @@ Hitbox searchForBlockCollision(Hitbox h, World &world)
 					glm::vec3(1.0f, 1.0f, 1.0f)
 				);
 
-				if(world.getBlock(x, y, z) != AIR && intersecting(h, block))
+				if(world.isSolid(x, y, z) && intersecting(h, block))
 					return block;
 			}		
 		}
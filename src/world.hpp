@@ -1,61 +1,466 @@
 #ifndef __WORLD_H__
 #include <stdint.h>
 #include <vector>
+#include <span>
+#include <utility>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
 #include <glm/glm.hpp>
 #include "hitbox.hpp"
+#include "blocks.hpp"
+#include "chunk.hpp"
+#include "chunkmap.hpp"
+#include "worldfile.hpp"
+#include "editjournal.hpp"
+#include "schematic.hpp"
+#include "blockquery.hpp"
+#include "sectiontable.hpp"
+#include <functional>
 
-enum Blocks : uint8_t
-{
-	AIR,
-	GRASS,
-	DIRT,
-	STONE,
-	BRICK,
-	WOOD,
-	BARK,
-	LOG,
-	LEAVES
-};
-
-const int32_t CHUNK_SIZE = 16;
-const int32_t TEXTURE_ATLAS_SIZE = 16;
 const float WORLD_SCALE = 2.0f;
+//Highest a world can be, the heightmaps store heights as 16 bit integers
+const uint32_t MAX_WORLD_HEIGHT = 32768;
+//Number of locks that the chunks are spread over
+const uint32_t CHUNK_LOCK_STRIPES = 64;
 
+//Mesh of one section on its way to being uploaded
 struct ChunkMesh
 {
 	std::vector<float> vertices;
-	int32_t index = -1;
+	Chunk *chunk = nullptr;
+	int32_t sectionY = 0;
+	//World edit version when the snapshots for the mesh were taken,
+	//a mesh older than the chunk's current mesh is thrown away
+	uint64_t version = 0;
+};
+
+//Snapshots of a chunk and the 8 chunks around it, this is
+//everything needed to mesh the chunk, so a mesh can be made
+//on another thread while the world is being changed
+struct ChunkNeighborhood
+{
+	//Indexed (dz + 1) * 3 + (dx + 1), nullptr if the chunk does not exist
+	std::shared_ptr<const ChunkSnapshot> chunks[9];
+
+	//dx and dz range from -1 to 1,
+	//returns nullptr if the section does not exist
+	const ChunkSection* getSection(int32_t dx, int32_t sectionY, int32_t dz) const;
+};
+
+//Counters for tuning how long chunks stay uncompressed
+struct ColdChunkStats
+{
+	//Chunk accesses that found the chunk uncompressed (hits)
+	//and that had to decompress it first (misses)
+	uint64_t hits = 0, misses = 0;
+	//Number of times a chunk was compressed and the total
+	//memory used by those chunks before and after compression
+	uint64_t compressions = 0;
+	uint64_t bytesBefore = 0, bytesAfter = 0;
+	//Number of chunks that are compressed right now
+	size_t coldChunks = 0;
+};
+
+//Bytes used by each part of the world, see World::memoryStats
+struct MemoryStats
+{
+	size_t chunkCount = 0, coldChunkCount = 0;
+	//Sections, palettes, occupancy masks, compressed blocks and block entities
+	size_t blockBytes = 0, maxChunkBlockBytes = 0;
+	//Undo and redo history
+	size_t undoHistoryBytes = 0;
+	//Memory reserved from the OS for section data, including free blocks
+	size_t sectionDataReserved = 0;
+	//What the blocks would use stored as one byte each
+	size_t denseBlockBytes = 0;
+	size_t chunkMapBytes = 0;
+	//Meshes only exist on the CPU between being made and being uploaded,
+	//this is the most vertex data that has been held at once
+	size_t meshStagingPeak = 0, maxChunkMeshBytes = 0;
+	//Vertex buffers on the GPU
+	size_t gpuBytes = 0, maxChunkGpuBytes = 0;
+	//Size of the world file mapping, the OS pages it in and out as needed
+	size_t worldFileBytes = 0;
+
+	//Returns the bytes used in system memory (not counting the world file)
+	size_t total() const;
+	void print(std::ostream &out) const;
 };
 
+//How much section data is shared between sections
+//with the same blocks (see World::dedupSections)
+struct SectionDedupStats
+{
+	size_t sections = 0;
+	//Sections that are one type of block have no data to share
+	size_t uniformSections = 0;
+	//Sections that have data and the number of different copies of data they use
+	size_t dataSections = 0, distinctData = 0;
+	//Bytes the section data would use if no sections
+	//shared their data and the bytes it actually uses
+	size_t unsharedBytes = 0, residentBytes = 0;
+
+	//Sections with data per copy of data
+	double ratio() const;
+	void print(std::ostream &out) const;
+};
+
+//Snapshots that have been taken so far, by chunk coordinate
+typedef std::map<std::pair<int32_t, int32_t>, std::shared_ptr<const ChunkSnapshot>> PinnedSnapshots;
+
+//Positions grouped by the chunk they are in (see World::bucketByChunk)
+struct ChunkBuckets
+{
+	//A position and where it is in its chunk, packed as y << 8 | z << 4 | x
+	struct Query
+	{
+		uint32_t index;
+		uint32_t local;
+	};
+
+	//Coordinates of the chunk of each bucket
+	std::vector<std::pair<int32_t, int32_t>> chunks;
+	//Bucket i is queries[start[i]] -> queries[start[i + 1]],
+	//in the same order as the positions
+	std::vector<uint32_t> start;
+	std::vector<Query> queries;
+};
+
+//Converts a block coordinate to the coordinate of the chunk it is in
+inline int32_t worldToChunkCoord(int32_t coord)
+{
+	if(coord < 0)
+		return (coord + 1) / CHUNK_SIZE - 1;
+	return coord / CHUNK_SIZE;
+}
+
+//Concurrency model:
+//
+//Every chunk is protected by one of CHUNK_LOCK_STRIPES reader-writer
+//locks, picked by hashing the chunk's coordinates. The lock covers the
+//chunk's blocks, block entities, heightmap, version, cold state and
+//decorated flag.
+//Reads (getBlock, isSolid, getHeight, taking snapshots) hold it shared
+//and edits hold it exclusively, an edit that spans several chunks
+//(fillRegion, replaceInRegion, decorating a chunk) locks all of them
+//at once so other threads never see half of it.
+//
+//Locks are always taken in this order and released before
+//anything earlier in the order is taken:
+//	1. chunk locks, in increasing stripe index
+//	2. journalLock
+//	3. dirtyLock or fileLock
+//	4. chunkMapLock
+//
+//The block access functions (getBlock, getBlocks, setBlock, setBlocks, fillRegion,
+//replaceInRegion, copyRegion, pasteRegion, isSolid, getHeight, getVisibleFaces,
+//fillBlockView, the region queries, the block entity functions, coldChunkStats,
+//beginEdit, endEdit, undo, redo) can be called from any thread at any time.
+//Everything else, including generating chunks, building meshes and
+//drawing, has to be called from the thread that owns the OpenGL context,
+//it runs safely alongside the block access functions on other threads.
+//Chunks are never removed, so a Chunk pointer stays valid, but getChunk
+//does not keep the chunk locked and should only be used on the main thread.
+//Meshes are made from snapshots (see ChunkSnapshot) which can be read
+//from any thread without any locks.
 class World
 {
-	uint8_t *blocks = nullptr;
+	//Blocks are stored chunk by chunk, each chunk is a column
+	//of palette compressed sections so that anything working
+	//on a single chunk only touches one region of memory,
+	//chunks are only created once they are generated and only
+	//reach as high as their highest block (see Chunk).
+	//Meshes are made, culled and drawn per section
+	ChunkMap chunks;
 	uint32_t worldSize, worldHeight;
+	//Optional file that chunks are saved to and loaded from
+	WorldFile file;
+	//Increased on every edit, dirty sections are stamped with it when
+	//they are changed and meshes are stamped with it when they are made
+	uint64_t editVersion = 0;
+	//Sections ((chunkX, sectionY, chunkZ), edit version) that may need
+	//to be rebuilt, can contain duplicates and sections that have since
+	//been rebuilt
+	std::vector<std::pair<glm::ivec3, uint64_t>> dirtySections;
+	//Time of the last call to compressColdChunks,
+	//chunks are stamped with it when they are accessed
+	std::atomic<double> clock = 0.0;
+	//Counters returned by coldChunkStats
+	std::atomic<uint64_t> coldHits = 0, coldMisses = 0, coldCompressions = 0;
+	std::atomic<uint64_t> coldBytesBefore = 0, coldBytesAfter = 0;
+	std::atomic<size_t> coldChunkCount = 0;
+	//Most mesh data that buildChunks has held at once
+	size_t meshStagingPeak = 0;
+
+	//Protects the chunk map, only held while looking up or adding a chunk
+	mutable std::shared_mutex chunkMapLock;
+	//Chunk (x, z) is protected by chunkLocks[chunkLockIndex(x, z)]
+	mutable std::shared_mutex chunkLocks[CHUNK_LOCK_STRIPES];
+	//Protects editVersion and dirtySections, the meshes of
+	//the chunks are only used by the OpenGL thread
+	std::mutex dirtyLock;
+	//Held exclusively while the world file mapping can move (adding
+	//chunks, opening the file) and shared while reading or writing slots
+	std::shared_mutex fileLock;
+	//Protects journal and editDepth
+	std::mutex journalLock;
+	//Undo history, only edits made through the public edit
+	//functions are recorded (not generation or decoration)
+	EditJournal journal;
+	//Number of beginEdit calls without a matching endEdit
+	uint32_t editDepth = 0;
+	//Runs dedupSections for startDedupSections,
+	//dedupRunning is cleared once the pass is done
+	std::thread dedupThread;
+	std::atomic<bool> dedupRunning = false;
 
-	std::vector<unsigned int> buffers;
-	std::vector<unsigned int> chunkVertexCount;
-	std::vector<unsigned int> chunkVaos;
+	static uint32_t chunkLockIndex(int32_t chunkX, int32_t chunkZ);
+	//Looks up a chunk without decompressing it
+	Chunk* findChunk(int32_t chunkX, int32_t chunkZ) const;
+	std::vector<Chunk*> allChunks() const;
+	//Decompresses the chunk if it is cold and stamps its access time,
+	//the chunk's lock has to be held exclusively
+	void thawChunk(Chunk *chunk);
+	//Lock a chunk, decompressing it if it is cold
+	std::shared_lock<std::shared_mutex> lockChunkShared(Chunk *chunk);
+	std::unique_lock<std::shared_mutex> lockChunk(Chunk *chunk);
+	//Exclusively locks every chunk in the box of chunk coordinates
+	//(inclusive) and decompresses the ones that exist
+	std::vector<std::unique_lock<std::shared_mutex>> lockChunks(int32_t minChunkX, int32_t minChunkZ,
+																int32_t maxChunkX, int32_t maxChunkZ);
+	//Same as getBlock and setBlock for when the lock of the
+	//chunk that the block is in is already held exclusively (see lockChunks)
+	//setBlockLocked returns the block that was replaced
+	uint8_t getBlockLocked(int32_t x, int32_t y, int32_t z);
+	uint8_t setBlockLocked(int32_t x, int32_t y, int32_t z, uint8_t block);
+	//Same as setBlockLocked for a block relative to a chunk,
+	//nothing is saved or marked dirty if the block does not change
+	uint8_t setChunkBlockLocked(Chunk *chunk, int32_t localX, int32_t y, int32_t localZ, uint8_t block);
+	//Writes one block through to the world file
+	void saveBlock(Chunk *chunk, int32_t localX, int32_t y, int32_t localZ, uint8_t block);
+	//Writes one section (SECTION_VOLUME blocks indexed with
+	//chunkBlockIndex) through to the world file
+	void saveSection(Chunk *chunk, int32_t sectionY, const uint8_t *blocks);
+	//Writes the chunk's block entities to the world file,
+	//the chunk has to be locked
+	void saveBlockEntities(Chunk *chunk);
+	//Groups positions by chunk with a counting sort so that each chunk
+	//is only looked up and locked once, no matter what order the positions
+	//are in. Positions above or below the world are left out
+	ChunkBuckets bucketByChunk(std::span<const glm::ivec3> positions);
+	//Closes the journal's transaction unless it is part of
+	//a beginEdit/endEdit group, journalLock has to be held
+	void commitEdit();
+	//Snapshots of every chunk that the box overlaps, missing chunks are left out
+	std::vector<std::shared_ptr<const ChunkSnapshot>> pinRegion(glm::ivec3 minPos, glm::ivec3 maxPos);
+	//Calls func(chunk index, section, part of the section in the box, section
+	//world position) for every section of the snapshots that overlaps the box.
+	//Large regions are split over several threads by chunk, every call for
+	//one chunk is made from the same thread
+	void forEachSectionInBox(const std::vector<std::shared_ptr<const ChunkSnapshot>> &snapshots,
+							 glm::ivec3 minPos, glm::ivec3 maxPos,
+							 const std::function<void(size_t, const ChunkSection&, const SectionBox&, glm::ivec3)> &func);
+	//Sets every block in the transaction back to its old
+	//blocks (undo) or to its new blocks (redo)
+	void applyTransaction(const EditTransaction &transaction, bool undo);
 
+	//Adds the visible faces of a block in the view,
+	//sectionPos is the world position of the view's section
 	void addBlockVertices(std::vector<float> &chunk,
-						  int32_t x, 
-						  int32_t y,
-						  int32_t z);
-	ChunkMesh createChunkMesh(int32_t chunkX, int32_t chunkZ);
+						  const BlockView &view,
+						  int32_t localX, 
+						  int32_t localY,
+						  int32_t localZ,
+						  glm::ivec3 sectionPos);
+	//Returns false if the section is guaranteed to not produce any faces
+	//(it is entirely air or entirely opaque and surrounded by opaque sections)
+	bool sectionCanHaveFaces(const ChunkNeighborhood &neighborhood, int32_t sectionY);
+	void getVisibleFaces(const ChunkNeighborhood &neighborhood, 
+						 int32_t sectionY,
+						 uint64_t faces[6][OCCUPANCY_WORDS]);
+	void fillBlockView(BlockView &view, const ChunkNeighborhood &neighborhood, int32_t sectionY);
+	//Adds the faces of one section of the neighborhood's center chunk,
+	//only reads from the snapshots, so this is safe to call
+	//from any thread while the world is being changed
+	void addSectionVertices(std::vector<float> &vertices, const ChunkNeighborhood &neighborhood, int32_t sectionY);
+	//Takes snapshots of the chunk and the chunks around it,
+	//snapshots that have already been taken are reused from pinned,
+	//each chunk is locked while its snapshot is taken
+	ChunkNeighborhood pinNeighborhood(int32_t chunkX, int32_t chunkZ, 
+									  PinnedSnapshots &pinned);
+	//Makes the chunk's sections share data with sections in the table
+	//that have the same blocks, the chunk has to be locked exclusively
+	void internChunk(Chunk *chunk, SectionTable &table);
+	//Fills in the terrain of a chunk, new chunks are generated
+	//before they are added to the map so no lock is needed
+	void generateTerrain(Chunk *chunk);
+	//Returns false if the chunk is not in the world file
+	bool loadChunk(Chunk *chunk);
+	//Writes every block of the chunk to the world file, adding the
+	//chunk to the file if it is not in it yet. The chunk has to be
+	//locked (or not added to the map yet)
+	void saveChunk(Chunk *chunk);
+	//Adds trees to a chunk, only done once all 8 surrounding chunks
+	//exist so that trees on the border are not cut off, all 9 chunks
+	//are locked while the trees are added.
+	//Returns true if the chunk was decorated
+	bool decorateChunk(int32_t chunkX, int32_t chunkZ);
+	//Uploads the mesh to the section's buffers, creating them if needed
+	void uploadSectionMesh(SectionMesh &mesh, const std::vector<float> &vertices);
+	//Builds every section ((chunkX, sectionY, chunkZ)) in the list once
+	//(duplicates are ignored), the meshes are created in parallel
+	void buildSections(std::vector<glm::ivec3> sectionCoords);
+	//Builds every section of the chunks in the list that can have a mesh
+	void buildChunks(const std::vector<std::pair<int32_t, int32_t>> &chunkCoords);
+	//Marks the sections that have to be rebuilt after the blocks
+	//in the box (inclusive) change as dirty, including neighboring
+	//sections whose border faces may have changed
+	void markDirty(glm::ivec3 minPos, glm::ivec3 maxPos);
 public:
-	//World ranges from
+	//The world has no fixed bounds, generateWorld fills in
 	//x: -size / 2 -> size / 2
-	//y: 0 -> height
 	//z: -size / 2 -> size / 2
+	//and more chunks are generated with generateChunksAround
+	//y: 0 -> height (at most MAX_WORLD_HEIGHT), the terrain is the
+	//same for any height and only the sections that have blocks in
+	//them are stored, so a tall world costs the same as a short one
+	//until something is built up high
 	World(uint32_t size, uint32_t height);
 	~World();
 
+	//Saves the world to a memory mapped file at path, chunks that
+	//are in the file are loaded from it instead of being generated
+	//and every change to the world is written to it.
+	//Call this before generating the world, returns false on failure
+	bool openWorldFile(const char *path);
+	//Writes changes to the world file to disk, if wait is
+	//false this only schedules the write and returns immediately
+	void syncWorldFile(bool wait);
+
 	void generateWorld();
+	//Generates up to maxChunks chunks that do not exist yet
+	//within radius chunks of (chunkX, chunkZ), closest first,
+	//then builds the meshes of any chunks that changed
+	void generateChunksAround(int32_t chunkX, int32_t chunkZ, int32_t radius, uint32_t maxChunks);
+	//For each face direction, sets the bit of every drawn (opaque or
+	//transparent) block in the section whose neighbor in that direction is
+	//not opaque, bits are laid out the same way as the section's occupancy mask
+	void getVisibleFaces(int32_t chunkX, 
+						 int32_t sectionY,
+						 int32_t chunkZ,
+						 uint64_t faces[6][OCCUPANCY_WORDS]);
+	//Copies a section and a one block border from the
+	//sections around it into view, missing sections are air
+	void fillBlockView(BlockView &view, int32_t chunkX, int32_t sectionY, int32_t chunkZ);
+	//Returns a pointer to a chunk, decompressing it if it is cold,
+	//returns nullptr if the chunk has not been generated.
+	//The chunk is not locked, see the concurrency model above
+	Chunk* getChunk(int32_t chunkX, int32_t chunkZ);
+	//Compresses every chunk that has not been accessed for
+	//coldAfter seconds, now is the current time in seconds
+	void compressColdChunks(double now, double coldAfter);
+	ColdChunkStats coldChunkStats() const;
+	//Returns AIR if the chunk has not been generated
 	uint8_t getBlock(int32_t x, int32_t y, int32_t z);
+	//Sets blocks[i] to the block at positions[i], the positions are
+	//grouped by chunk first so each chunk is only looked up and locked
+	//once no matter what order the positions are in
+	void getBlocks(std::span<const glm::ivec3> positions, std::span<uint8_t> blocks);
+	//Edits do not rebuild any chunks, they mark the chunks
+	//that need to be rebuilt as dirty (see buildDirtyChunks)
 	void setBlock(int32_t x, int32_t y, int32_t z, uint8_t block);
+	//Bulk edits, boxes are inclusive and may be
+	//given in any corner order
+	void fillRegion(glm::ivec3 pos1, glm::ivec3 pos2, uint8_t block);
+	void replaceInRegion(glm::ivec3 pos1, glm::ivec3 pos2, uint8_t from, uint8_t to);
+	//Sets positions[i] to blocks[i] as one undo step, like getBlocks each
+	//chunk is locked once and each section it changes is marked dirty once
+	void setBlocks(std::span<const glm::ivec3> positions, std::span<const uint8_t> blocks);
+	//Block entities hold extra state for a block as an opaque payload
+	//(see BlockEntity), they are saved with the chunk and removed when
+	//the block is changed to another type. Edits to them are not undone.
+	//setBlockEntity adds or replaces the entity of a block, it returns
+	//false if the block is air, the chunk has not been generated or the
+	//chunk's entities would not fit in the world file (BLOCK_ENTITY_SLOT_BYTES)
+	bool setBlockEntity(int32_t x, int32_t y, int32_t z, std::span<const uint8_t> data);
+	//Copies the payload of the block's entity to data,
+	//returns false if the block has no entity
+	bool getBlockEntity(int32_t x, int32_t y, int32_t z, std::vector<uint8_t> &data);
+	//Returns false if the block has no entity
+	bool removeBlockEntity(int32_t x, int32_t y, int32_t z);
+	//Calls func(position, block, payload) for every block entity in the
+	//chunk in storage order, the payload can be changed in place and func
+	//returns true if it changed it. The chunk is only saved if a payload
+	//changed. The chunk is locked while this runs, so func must not call
+	//back into the world
+	void tickBlockEntities(int32_t chunkX, int32_t chunkZ,
+						   const std::function<bool(glm::ivec3, uint8_t, std::span<uint8_t>)> &func);
+	//Copies the blocks in a box (inclusive, any corner order),
+	//blocks in chunks that have not been generated are air
+	Schematic copyRegion(glm::ivec3 pos1, glm::ivec3 pos2);
+	//Places a schematic with its lowest corner at pos, it is mirrored
+	//(see Schematic::mirrored) and then turned rotation quarter turns
+	//first. Air in the schematic is skipped unless pasteAir is set
+	void pasteRegion(const Schematic &schematic, glm::ivec3 pos,
+					 uint32_t rotation = 0, bool mirror = false, bool pasteAir = true);
+	//Region queries over a box (inclusive, any corner order), chunks
+	//that have not been generated are skipped. The chunks are read
+	//from snapshots so no locks are held while the blocks are scanned
+	BlockHistogram blockHistogram(glm::ivec3 pos1, glm::ivec3 pos2);
+	uint64_t countBlocks(glm::ivec3 pos1, glm::ivec3 pos2, uint8_t block);
+	//Positions are grouped by chunk, blocks in a section are in y, z, x order
+	std::vector<glm::ivec3> findBlocks(glm::ivec3 pos1, glm::ivec3 pos2, uint8_t block);
+	//Every edit is one undo step, edits made between beginEdit and
+	//the matching endEdit are grouped into a single step instead.
+	//Groups can be nested and are shared by all threads
+	void beginEdit();
+	void endEdit();
+	//Reverts the last undo step (or reapplies the last undone step),
+	//every chunk it touched is rebuilt once by buildDirtyChunks.
+	//Returns false if there is nothing to undo or a group is open
+	bool undo();
+	bool redo();
+	//Limits the memory used by the undo history, the oldest
+	//steps are forgotten first (see EditJournal)
+	void setUndoLimit(size_t bytes);
+	//Returns false for blocks that are not solid (see BlockType)
+	//and for chunks that have not been generated
+	bool isSolid(int32_t x, int32_t y, int32_t z);
+	//Returns the y value of the highest block that is not air
+	//in the column, returns -1 if there is no block in it
+	//or the chunk has not been generated
+	int32_t getHeight(int32_t x, int32_t z);
+	//Returns the number of bytes used to store blocks
+	size_t blockMemoryUsage();
+	//Returns the number of bytes that would be used if
+	//every block was stored as a single byte
+	size_t denseMemoryUsage();
+	//Returns how much memory each part of the world uses
+	MemoryStats memoryStats();
+	//Makes every section share its data with the other sections that have
+	//the same blocks. The table used to find them only lives for the call,
+	//so nothing keeps section data alive once the chunks let go of it.
+	//Goes through every chunk, call it once in a while (generateWorld
+	//calls it once), not for every new chunk
+	void dedupSections();
+	//Runs dedupSections on another thread and returns right away, it
+	//only locks one chunk at a time so the world can be used meanwhile.
+	//Does nothing if the last pass has not finished yet
+	void startDedupSections();
+	SectionDedupStats sectionDedupStats();
 	void buildChunk(int32_t chunkX, int32_t chunkZ);
 	void buildAllChunks();
+	//Rebuilds every section that has changed since it was last built,
+	//each section is only rebuilt once no matter how many edits were made
+	void buildDirtyChunks();
 	//Returns the number of triangles drawn	
-	//renderDist is in chunks
+	//renderDist is in chunks, sections further than that
+	//away from the camera along any axis are not drawn
 	int displayWorld(Frustum viewFrustum, glm::vec3 camPos, uint32_t renderDist);
 	//Call this before deleting the object
 	void deleteBuffers();
@@ -0,0 +1,382 @@
+#include "worldfile.hpp"
+#include "chunk.hpp"
+#include <string.h>
+#include <iostream>
+#include <algorithm>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+const char WORLD_FILE_MAGIC[4] = { 'B', 'G', 'W', 'F' };
+const uint32_t WORLD_FILE_VERSION = 4;
+//Maximum number of chunks and sections in a file is INDEX_CAPACITY * 3 / 4
+const uint32_t INDEX_CAPACITY_BITS = 21;
+const uint32_t INDEX_CAPACITY = 1 << INDEX_CAPACITY_BITS;
+//Number of slots added to the file whenever it runs out
+const uint64_t SLOT_GROWTH = 4096;
+//sectionY of the entry that every stored chunk has
+const int32_t CHUNK_ENTRY = -1;
+//Slots taken by a chunk's block entities
+const uint32_t BLOCK_ENTITY_SLOTS = (BLOCK_ENTITY_SLOT_BYTES + SECTION_VOLUME - 1) / SECTION_VOLUME;
+
+//Flags for an index entry
+//Set for every entry that is not empty
+const uint32_t ENTRY_USED = 1;
+const uint32_t CHUNK_DECORATED = 2;
+//The chunk's block entities are in slot
+const uint32_t CHUNK_HAS_BLOCK_ENTITIES = 4;
+
+struct Header
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t worldHeight;
+	uint32_t indexCapacity;
+	//Entries in the index
+	uint64_t entryCount;
+	uint64_t slotCount;
+	uint64_t slotCapacity;
+};
+
+struct IndexEntry
+{
+	int32_t chunkX, sectionY, chunkZ;
+	uint32_t flags;
+	//First slot of the section or of the chunk's block entities
+	uint32_t slot;
+	//Only used for chunk entries, one more
+	//than the highest stored section
+	uint32_t sectionCount;
+};
+
+WorldFile::~WorldFile()
+{
+	close();
+}
+
+Header* WorldFile::header() const
+{
+	return (Header*)map;
+}
+
+IndexEntry* WorldFile::index() const
+{
+	return (IndexEntry*)(map + sizeof(Header));
+}
+
+size_t WorldFile::slotsOffset() const
+{
+	//Keep slots page aligned
+	size_t offset = sizeof(Header) + sizeof(IndexEntry) * INDEX_CAPACITY;
+	return (offset + 4095) / 4096 * 4096;
+}
+
+IndexEntry* WorldFile::findEntry(int32_t chunkX, int32_t sectionY, int32_t chunkZ) const
+{
+	//The entries of a chunk go next to each other (the chunk's own entry
+	//first), so looking up a whole chunk only touches a page or two of
+	//the index
+	uint64_t key = (uint64_t(uint32_t(chunkX)) << 32) | uint64_t(uint32_t(chunkZ));
+	size_t i = size_t(((key * 0x9e3779b97f4a7c15ull) >> (64 - INDEX_CAPACITY_BITS)) + uint32_t(sectionY - CHUNK_ENTRY)) & 
+			   (INDEX_CAPACITY - 1);
+
+	IndexEntry *entries = index();
+	while((entries[i].flags & ENTRY_USED) && 
+		  (entries[i].chunkX != chunkX || entries[i].sectionY != sectionY || entries[i].chunkZ != chunkZ))
+		i = (i + 1) & (INDEX_CAPACITY - 1);
+	return &entries[i];
+}
+
+IndexEntry* WorldFile::findChunkEntry(int32_t chunkX, int32_t chunkZ) const
+{
+	if(!map)
+		return nullptr;
+
+	IndexEntry *entry = findEntry(chunkX, CHUNK_ENTRY, chunkZ);
+	return (entry->flags & ENTRY_USED) ? entry : nullptr;
+}
+
+int64_t WorldFile::takeSlots(uint32_t count)
+{
+	if(header()->slotCount + count > header()->slotCapacity)
+	{
+		uint64_t capacity = header()->slotCapacity + std::max(SLOT_GROWTH, uint64_t(count));
+		if(!remap(slotsOffset() + SECTION_VOLUME * capacity))
+		{
+			std::cerr << "Failed to grow world file\n";
+			return -1;
+		}
+		header()->slotCapacity = capacity;
+	}
+
+	int64_t first = header()->slotCount;
+	header()->slotCount += count;
+	return first;
+}
+
+IndexEntry* WorldFile::addEntry(int32_t chunkX, int32_t sectionY, int32_t chunkZ, uint32_t count)
+{
+	//Keep the index at most 3/4 full
+	if(header()->entryCount + 1 > uint64_t(INDEX_CAPACITY) * 3 / 4)
+		return nullptr;
+
+	int64_t first = takeSlots(count);
+	if(first < 0)
+		return nullptr;
+
+	IndexEntry *entry = findEntry(chunkX, sectionY, chunkZ);
+	entry->chunkX = chunkX;
+	entry->sectionY = sectionY;
+	entry->chunkZ = chunkZ;
+	entry->flags = ENTRY_USED;
+	entry->slot = uint32_t(first);
+	entry->sectionCount = 0;
+	header()->entryCount++;
+	return entry;
+}
+
+#ifdef _WIN32
+
+bool WorldFile::remap(size_t newSize)
+{
+	return false;
+}
+
+bool WorldFile::open(const char *path, uint32_t worldHeight)
+{
+	std::cerr << "World files are not supported on this platform\n";
+	return false;
+}
+
+void WorldFile::close()
+{
+}
+
+void WorldFile::prefetch(int32_t chunkX, int32_t chunkZ) const
+{
+}
+
+void WorldFile::sync(bool wait)
+{
+}
+
+#else
+
+bool WorldFile::remap(size_t newSize)
+{
+	if(map)
+		munmap(map, mapSize);
+	map = nullptr;
+
+	if(ftruncate(fd, newSize) != 0)
+		return false;
+
+	void *newMap = mmap(nullptr, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(newMap == MAP_FAILED)
+		return false;
+
+	map = (uint8_t*)newMap;
+	mapSize = newSize;
+	//Chunks are visited in whatever order the player explores
+	madvise(map, mapSize, MADV_RANDOM);
+	return true;
+}
+
+bool WorldFile::open(const char *path, uint32_t worldHeight)
+{
+	close();
+
+	fd = ::open(path, O_RDWR | O_CREAT, 0644);
+	if(fd < 0)
+	{
+		std::cerr << "Failed to open world file " << path << '\n';
+		return false;
+	}
+
+	struct stat info;
+	fstat(fd, &info);
+	bool created = info.st_size == 0;
+	size_t size = created ? slotsOffset() + SECTION_VOLUME * SLOT_GROWTH : info.st_size;
+
+	if(!remap(size))
+	{
+		std::cerr << "Failed to map world file " << path << '\n';
+		close();
+		return false;
+	}
+
+	if(created)
+	{
+		//ftruncate fills the file with zeros, so the index starts empty
+		memcpy(header()->magic, WORLD_FILE_MAGIC, 4);
+		header()->version = WORLD_FILE_VERSION;
+		header()->worldHeight = worldHeight;
+		header()->indexCapacity = INDEX_CAPACITY;
+		header()->entryCount = 0;
+		header()->slotCount = 0;
+		header()->slotCapacity = SLOT_GROWTH;
+	}
+	else if(memcmp(header()->magic, WORLD_FILE_MAGIC, 4) != 0 ||
+			header()->version != WORLD_FILE_VERSION ||
+			header()->worldHeight != worldHeight ||
+			header()->indexCapacity != INDEX_CAPACITY ||
+			mapSize < slotsOffset() + SECTION_VOLUME * header()->slotCapacity)
+	{
+		std::cerr << "World file " << path << " is not compatible with this world\n";
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void WorldFile::close()
+{
+	if(map)
+	{
+		msync(map, mapSize, MS_SYNC);
+		munmap(map, mapSize);
+	}
+	map = nullptr;
+	mapSize = 0;
+
+	if(fd >= 0)
+		::close(fd);
+	fd = -1;
+}
+
+void WorldFile::prefetch(int32_t chunkX, int32_t chunkZ) const
+{
+	IndexEntry *entry = findChunkEntry(chunkX, chunkZ);
+	if(!entry)
+		return;
+	//Only the stored sections are read ahead. A chunk's sections are
+	//usually added together and end up next to each other in the file,
+	//so runs of them are read ahead at once
+	uint8_t *start = nullptr, *end = nullptr;
+	for(uint32_t sectionY = 0; sectionY < entry->sectionCount; sectionY++)
+	{
+		uint8_t *blocks = section(chunkX, sectionY, chunkZ);
+		if(!blocks)
+			continue;
+		if(blocks != end)
+		{
+			if(start)
+				madvise(start, end - start, MADV_WILLNEED);
+			start = blocks;
+		}
+		end = blocks + SECTION_VOLUME;
+	}
+	if(start)
+		madvise(start, end - start, MADV_WILLNEED);
+}
+
+void WorldFile::sync(bool wait)
+{
+	if(map)
+		msync(map, mapSize, wait ? MS_SYNC : MS_ASYNC);
+}
+
+#endif
+
+bool WorldFile::isOpen() const
+{
+	return map != nullptr;
+}
+
+size_t WorldFile::mappedSize() const
+{
+	return mapSize;
+}
+
+bool WorldFile::hasChunk(int32_t chunkX, int32_t chunkZ) const
+{
+	return findChunkEntry(chunkX, chunkZ) != nullptr;
+}
+
+bool WorldFile::addChunk(int32_t chunkX, int32_t chunkZ)
+{
+	if(!map)
+		return false;
+	return findChunkEntry(chunkX, chunkZ) || addEntry(chunkX, CHUNK_ENTRY, chunkZ, 0);
+}
+
+uint8_t* WorldFile::section(int32_t chunkX, int32_t sectionY, int32_t chunkZ) const
+{
+	if(!map)
+		return nullptr;
+
+	IndexEntry *entry = findEntry(chunkX, sectionY, chunkZ);
+	if(!(entry->flags & ENTRY_USED))
+		return nullptr;
+	return map + slotsOffset() + SECTION_VOLUME * size_t(entry->slot);
+}
+
+uint8_t* WorldFile::addSection(int32_t chunkX, int32_t sectionY, int32_t chunkZ)
+{
+	if(uint8_t *blocks = section(chunkX, sectionY, chunkZ))
+		return blocks;
+	if(!findChunkEntry(chunkX, chunkZ) || sectionY < 0)
+		return nullptr;
+
+	//New slots are zero (air) since the file is grown with ftruncate
+	IndexEntry *entry = addEntry(chunkX, sectionY, chunkZ, 1);
+	if(!entry)
+		return nullptr;
+	uint8_t *blocks = map + slotsOffset() + SECTION_VOLUME * size_t(entry->slot);
+
+	//Adding the entry can move the mapping
+	IndexEntry *chunk = findChunkEntry(chunkX, chunkZ);
+	chunk->sectionCount = std::max(chunk->sectionCount, uint32_t(sectionY) + 1);
+	return blocks;
+}
+
+uint8_t* WorldFile::blockEntitySlot(int32_t chunkX, int32_t chunkZ) const
+{
+	IndexEntry *entry = findChunkEntry(chunkX, chunkZ);
+	if(!entry || !(entry->flags & CHUNK_HAS_BLOCK_ENTITIES))
+		return nullptr;
+	return map + slotsOffset() + SECTION_VOLUME * size_t(entry->slot);
+}
+
+uint8_t* WorldFile::addBlockEntitySlot(int32_t chunkX, int32_t chunkZ)
+{
+	if(uint8_t *entities = blockEntitySlot(chunkX, chunkZ))
+		return entities;
+	IndexEntry *entry = findChunkEntry(chunkX, chunkZ);
+	if(!entry)
+		return nullptr;
+
+	//The slots do not get an entry of their own,
+	//the chunk's entry points at them
+	int64_t first = takeSlots(BLOCK_ENTITY_SLOTS);
+	if(first < 0)
+		return nullptr;
+
+	//Taking slots can move the mapping
+	entry = findChunkEntry(chunkX, chunkZ);
+	entry->slot = uint32_t(first);
+	entry->flags |= CHUNK_HAS_BLOCK_ENTITIES;
+	return map + slotsOffset() + SECTION_VOLUME * size_t(first);
+}
+
+bool WorldFile::isDecorated(int32_t chunkX, int32_t chunkZ) const
+{
+	IndexEntry *entry = findChunkEntry(chunkX, chunkZ);
+	return entry && (entry->flags & CHUNK_DECORATED);
+}
+
+void WorldFile::setDecorated(int32_t chunkX, int32_t chunkZ)
+{
+	if(IndexEntry *entry = findChunkEntry(chunkX, chunkZ))
+		entry->flags |= CHUNK_DECORATED;
+}
+
+uint32_t WorldFile::sectionCount(int32_t chunkX, int32_t chunkZ) const
+{
+	IndexEntry *entry = findChunkEntry(chunkX, chunkZ);
+	return entry ? entry->sectionCount : 0;
+}
@@ -0,0 +1,98 @@
+#ifndef __WORLDFILE_H__
+#include <stdint.h>
+#include <stddef.h>
+
+//Bytes set aside for a chunk's block entities, a uint32_t size
+//followed by BlockEntityMap::serialize's output
+const size_t BLOCK_ENTITY_SLOT_BYTES = 16384;
+
+//File that blocks are stored in so that the world survives
+//restarts, the file is memory mapped so opening it is instant
+//and chunks are only read from disk once they are needed.
+//
+//Layout:
+//Header
+//Index (open addressing hash table of (chunkX, sectionY, chunkZ) -> slot,
+//       every stored chunk has an entry with sectionY = -1 for its
+//       flags and block entities and an entry for each stored section)
+//Slots (SECTION_VOLUME bytes each, the blocks of one section as one
+//       byte each indexed with chunkBlockIndex. A chunk's block
+//       entities take BLOCK_ENTITY_SLOT_BYTES worth of slots in a row)
+//
+//Sections are only stored once something other than air is written
+//to them, so the sky above a chunk and chunks without block entities
+//take no room in the file.
+//Only supported on systems with mmap, open() fails everywhere else.
+//Not thread safe, adding a chunk, section or block entities can move
+//the mapping.
+class WorldFile
+{
+	int fd = -1;
+	uint8_t *map = nullptr;
+	size_t mapSize = 0;
+
+	struct Header *header() const;
+	struct IndexEntry *index() const;
+	size_t slotsOffset() const;
+	//Returns the entry for the key, or the empty entry where it would go
+	struct IndexEntry *findEntry(int32_t chunkX, int32_t sectionY, int32_t chunkZ) const;
+	//Returns the entry of a stored chunk, nullptr if it is not stored
+	struct IndexEntry *findChunkEntry(int32_t chunkX, int32_t chunkZ) const;
+	//Returns the first of count new slots at the end of the file,
+	//growing the file if needed, -1 if it could not be grown
+	int64_t takeSlots(uint32_t count);
+	//Adds an entry for the key with count slots (can be 0),
+	//returns nullptr if the file is full
+	struct IndexEntry *addEntry(int32_t chunkX, int32_t sectionY, int32_t chunkZ, uint32_t count);
+	bool remap(size_t newSize);
+public:
+	WorldFile() = default;
+	WorldFile(const WorldFile&) = delete;
+	WorldFile& operator=(const WorldFile&) = delete;
+	~WorldFile();
+
+	//Opens the file at path, creating it if it does not exist,
+	//returns false if the file could not be opened or was made
+	//for a world with a different height
+	bool open(const char *path, uint32_t worldHeight);
+	void close();
+	bool isOpen() const;
+	//Returns the number of bytes mapped, only the parts
+	//that have been read or written are in memory
+	size_t mappedSize() const;
+
+	bool hasChunk(int32_t chunkX, int32_t chunkZ) const;
+	//Adds a chunk with no sections (all air), returns
+	//false if the file is full. Does nothing if the
+	//chunk is already stored
+	bool addChunk(int32_t chunkX, int32_t chunkZ);
+	//Blocks of a stored section of a stored chunk, nullptr if the
+	//section is not stored (all air). The pointer is only valid
+	//until the mapping next moves
+	uint8_t* section(int32_t chunkX, int32_t sectionY, int32_t chunkZ) const;
+	//Same as section, but stores the section (as air) if it is not
+	//stored yet, returns nullptr if the file is full
+	uint8_t* addSection(int32_t chunkX, int32_t sectionY, int32_t chunkZ);
+	//Block entity area of a stored chunk (BLOCK_ENTITY_SLOT_BYTES),
+	//nullptr if the chunk never had any. The pointer is only
+	//valid until the mapping next moves
+	uint8_t* blockEntitySlot(int32_t chunkX, int32_t chunkZ) const;
+	//Same as blockEntitySlot, but adds an empty area if the
+	//chunk does not have one yet, nullptr if the file is full
+	uint8_t* addBlockEntitySlot(int32_t chunkX, int32_t chunkZ);
+	bool isDecorated(int32_t chunkX, int32_t chunkZ) const;
+	void setDecorated(int32_t chunkX, int32_t chunkZ);
+	//One more than the highest stored section of the chunk,
+	//sections from there up are air. 0 if the chunk is not stored
+	uint32_t sectionCount(int32_t chunkX, int32_t chunkZ) const;
+	//Tell the OS that the stored sections of the chunk are
+	//about to be read
+	void prefetch(int32_t chunkX, int32_t chunkZ) const;
+	//Writes changes back to disk, if wait is false the
+	//write is only scheduled
+	void sync(bool wait);
+};
+
+#endif
+
+#define __WORLDFILE_H__
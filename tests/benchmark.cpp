@@ -0,0 +1,307 @@
+#include <iostream>
+#include <chrono>
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+#include <random>
+#include <fstream>
+#include "world.hpp"
+#include "glstub.hpp"
+
+//Headless benchmark of the world code, OpenGL is stubbed
+//out so only the CPU side of meshing is measured.
+//Usage: benchmark [--size N] [--height N] [case...]
+//runs every case if none are named
+
+struct Options
+{
+	uint32_t size = 512, height = 128;
+};
+
+struct BenchmarkCase
+{
+	const char *name;
+	void (*run)(World &world, const Options &options);
+};
+
+static double seconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//Bytes of the process that are in memory (Linux only, 0 elsewhere)
+static size_t residentBytes()
+{
+	std::ifstream statm("/proc/self/statm");
+	size_t pages = 0, resident = 0;
+	statm >> pages >> resident;
+	return resident * 4096;
+}
+
+//Builds the mesh of every chunk one chunk at a time
+static void benchmarkMesh(World &world, const Options &options)
+{
+	int32_t halfChunks = options.size / (2 * CHUNK_SIZE);
+	double start = seconds();
+	for(int32_t x = -halfChunks; x < halfChunks; x++)
+		for(int32_t z = -halfChunks; z < halfChunks; z++)
+			world.buildChunk(x, z);
+	double time = seconds() - start;
+
+	size_t chunkCount = size_t(halfChunks) * size_t(halfChunks) * 4;
+	std::cout << "mesh: " << time << " s, " << time / chunkCount * 1e6 << " us per chunk ("
+			  << chunkCount << " chunks)\n";
+}
+
+//Reads the 6 neighbors of every block in the sections around the
+//middle of the world, once through BlockViews like the mesher does
+//and once through World::getBlock like the mesher did before views
+static void benchmarkBlockView(World &world, const Options &options)
+{
+	const int32_t CHUNK_RADIUS = 4;
+	const int32_t OFFSETS[6] = {
+		BlockView::STRIDE_X, -BlockView::STRIDE_X,
+		BlockView::STRIDE_Y, -BlockView::STRIDE_Y,
+		BlockView::STRIDE_Z, -BlockView::STRIDE_Z,
+	};
+	int32_t sectionCount = (options.height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+	uint64_t viewSum = 0;
+	BlockView view;
+	double start = seconds();
+	for(int32_t chunkX = -CHUNK_RADIUS; chunkX < CHUNK_RADIUS; chunkX++)
+	{
+		for(int32_t chunkZ = -CHUNK_RADIUS; chunkZ < CHUNK_RADIUS; chunkZ++)
+		{
+			for(int32_t sectionY = 0; sectionY < sectionCount; sectionY++)
+			{
+				world.fillBlockView(view, chunkX, sectionY, chunkZ);
+				for(int32_t y = 0; y < CHUNK_SIZE; y++)
+					for(int32_t z = 0; z < CHUNK_SIZE; z++)
+						for(int32_t x = 0; x < CHUNK_SIZE; x++)
+							for(int32_t offset : OFFSETS)
+								viewSum += view.blocks[BlockView::index(x, y, z) + offset];
+			}
+		}
+	}
+	double viewTime = seconds() - start;
+
+	uint64_t getBlockSum = 0;
+	start = seconds();
+	for(int32_t chunkX = -CHUNK_RADIUS; chunkX < CHUNK_RADIUS; chunkX++)
+	{
+		for(int32_t chunkZ = -CHUNK_RADIUS; chunkZ < CHUNK_RADIUS; chunkZ++)
+		{
+			for(int32_t y = 0; y < sectionCount * CHUNK_SIZE; y++)
+			{
+				for(int32_t z = chunkZ * CHUNK_SIZE; z < (chunkZ + 1) * CHUNK_SIZE; z++)
+				{
+					for(int32_t x = chunkX * CHUNK_SIZE; x < (chunkX + 1) * CHUNK_SIZE; x++)
+					{
+						getBlockSum += world.getBlock(x + 1, y, z) + world.getBlock(x - 1, y, z) +
+									   world.getBlock(x, y + 1, z) + world.getBlock(x, y - 1, z) +
+									   world.getBlock(x, y, z + 1) + world.getBlock(x, y, z - 1);
+					}
+				}
+			}
+		}
+	}
+	double getBlockTime = seconds() - start;
+
+	int32_t chunkCount = 4 * CHUNK_RADIUS * CHUNK_RADIUS;
+	std::cout << "blockview: " << viewTime / chunkCount * 1e6 << " us per chunk with views, "
+			  << getBlockTime / chunkCount * 1e6 << " us per chunk with getBlock ("
+			  << chunkCount << " chunks";
+	if(viewSum != getBlockSum)
+		std::cout << ", the two do not read the same blocks";
+	std::cout << ")\n";
+}
+
+//Casts rays from random points above the terrain in random directions,
+//the same way the player picks the block they are looking at
+static void benchmarkRaycast(World &world, const Options &options)
+{
+	const size_t RAY_COUNT = 20000;
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> angle(0.0f, 6.2831853f), pitch(-1.5f, 1.5f);
+	int32_t halfSize = options.size / 2;
+
+	float sum = 0.0f;
+	double start = seconds();
+	for(size_t i = 0; i < RAY_COUNT; i++)
+	{
+		int32_t x = int32_t(rng() % options.size) - halfSize,
+				z = int32_t(rng() % options.size) - halfSize;
+		glm::vec3 from = glm::vec3(x, world.getHeight(x, z) + 2.0f, z);
+		sum += raycast(world, from, angle(rng), pitch(rng), 8.0f).y;
+	}
+	double time = seconds() - start;
+	std::cout << "raycast: " << time / RAY_COUNT * 1e6 << " us per ray (" << RAY_COUNT << " rays, " << sum << ")\n";
+}
+
+//Checks a player sized hitbox for collisions at random points near the
+//surface, the same way the player is moved every frame
+static void benchmarkCollision(World &world, const Options &options)
+{
+	const size_t CHECK_COUNT = 200000;
+	std::mt19937 rng(2);
+	std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+	int32_t halfSize = options.size / 2;
+
+	size_t hits = 0;
+	double start = seconds();
+	for(size_t i = 0; i < CHECK_COUNT; i++)
+	{
+		int32_t x = int32_t(rng() % options.size) - halfSize,
+				z = int32_t(rng() % options.size) - halfSize;
+		glm::vec3 pos = glm::vec3(x + offset(rng), world.getHeight(x, z) + 1.0f + offset(rng), z + offset(rng));
+		Hitbox hitbox = Hitbox(pos, glm::vec3(0.6f, 1.8f, 0.6f));
+		if(searchForBlockCollision(hitbox, world).dimensions.x > 0.0f)
+			hits++;
+	}
+	double time = seconds() - start;
+	std::cout << "collision: " << time / CHECK_COUNT * 1e6 << " us per check (" << CHECK_COUNT << " checks, "
+			  << hits << " hits)\n";
+}
+
+//Reads the same positions one getBlock at a time and with one getBlocks
+//call, for random positions, points along rays and the 3 x 3 x 3 blocks
+//around random positions
+static void benchmarkGather(World &world, const Options &options)
+{
+	const size_t POSITION_COUNT = 1 << 20;
+	std::mt19937 rng(3);
+	int32_t halfSize = options.size / 2;
+	auto randomPosition = [&]() {
+		return glm::ivec3(int32_t(rng() % options.size) - halfSize, rng() % options.height,
+						  int32_t(rng() % options.size) - halfSize);
+	};
+
+	struct Pattern
+	{
+		const char *name;
+		std::vector<glm::ivec3> positions;
+	} patterns[3] = { { "random", {} }, { "ray", {} }, { "neighborhood", {} } };
+
+	while(patterns[0].positions.size() < POSITION_COUNT)
+		patterns[0].positions.push_back(randomPosition());
+
+	std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+	while(patterns[1].positions.size() < POSITION_COUNT)
+	{
+		glm::vec3 pos = glm::vec3(randomPosition()),
+				  step = glm::vec3(direction(rng), direction(rng), direction(rng)) * 0.5f;
+		for(int i = 0; i < 64; i++, pos += step)
+			patterns[1].positions.push_back(glm::ivec3(glm::floor(pos)));
+	}
+
+	while(patterns[2].positions.size() < POSITION_COUNT)
+	{
+		glm::ivec3 center = randomPosition();
+		for(int32_t y = -1; y <= 1; y++)
+			for(int32_t z = -1; z <= 1; z++)
+				for(int32_t x = -1; x <= 1; x++)
+					patterns[2].positions.push_back(center + glm::ivec3(x, y, z));
+	}
+
+	for(auto &pattern : patterns)
+	{
+		std::vector<uint8_t> scalar(pattern.positions.size()), batched(pattern.positions.size());
+		double start = seconds();
+		for(size_t i = 0; i < pattern.positions.size(); i++)
+			scalar[i] = world.getBlock(pattern.positions[i].x, pattern.positions[i].y, pattern.positions[i].z);
+		double scalarTime = seconds() - start;
+
+		start = seconds();
+		world.getBlocks(pattern.positions, batched);
+		double batchedTime = seconds() - start;
+
+		std::cout << "gather " << pattern.name << ": " << scalarTime / pattern.positions.size() * 1e9
+				  << " ns per block with getBlock, " << batchedTime / pattern.positions.size() * 1e9
+				  << " ns per block with getBlocks";
+		if(scalar != batched)
+			std::cout << " (the two do not read the same blocks)";
+		std::cout << '\n';
+	}
+}
+
+//Memory used by the section data before and after sharing it between
+//sections with the same blocks (generateWorld already did it once)
+static void benchmarkDedup(World &world, const Options&)
+{
+	const double MIB = 1024.0 * 1024.0;
+	size_t residentBefore = residentBytes(),
+		   reservedBefore = world.memoryStats().sectionDataReserved;
+	double start = seconds();
+	world.dedupSections();
+	double time = seconds() - start;
+
+	SectionDedupStats stats = world.sectionDedupStats();
+	MemoryStats memory = world.memoryStats();
+	std::cout << "dedup: " << time << " s, ratio " << stats.ratio() << ", section data "
+			  << stats.unsharedBytes / MIB << " MiB without sharing, " << stats.residentBytes / MIB
+			  << " MiB shared, blocks " << memory.blockBytes / MIB << " MiB, total " << memory.total() / MIB << " MiB\n"
+			  << "  section data reserved: " << reservedBefore / MIB << " -> " << memory.sectionDataReserved / MIB
+			  << " MiB, process resident: " << residentBefore / MIB << " -> " << residentBytes() / MIB << " MiB\n";
+}
+
+static const BenchmarkCase CASES[] = {
+	{ "mesh", benchmarkMesh },
+	{ "blockview", benchmarkBlockView },
+	{ "raycast", benchmarkRaycast },
+	{ "collision", benchmarkCollision },
+	{ "gather", benchmarkGather },
+	{ "dedup", benchmarkDedup },
+};
+
+int main(int argc, char **argv)
+{
+	Options options;
+	std::vector<const BenchmarkCase*> selected;
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+			options.size = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--height") == 0 && i + 1 < argc)
+			options.height = atoi(argv[++i]);
+		else
+		{
+			const BenchmarkCase *found = nullptr;
+			for(const auto &benchmarkCase : CASES)
+				if(strcmp(argv[i], benchmarkCase.name) == 0)
+					found = &benchmarkCase;
+			if(!found)
+			{
+				std::cerr << "Unknown benchmark " << argv[i] << '\n';
+				return 1;
+			}
+			selected.push_back(found);
+		}
+	}
+
+	if(selected.empty())
+		for(const auto &benchmarkCase : CASES)
+			selected.push_back(&benchmarkCase);
+
+	stubOpenGL();
+#ifdef BLOCKGAME_MORTON_LAYOUT
+	std::cout << "layout: morton";
+#else
+	std::cout << "layout: linear";
+#endif
+#ifdef __BMI2__
+	std::cout << " (bmi2)";
+#endif
+	std::cout << '\n';
+
+	//Every case needs a world, so generating it is always measured
+	World world(options.size, options.height);
+	double start = seconds();
+	world.generateWorld();
+	std::cout << "generate: " << seconds() - start << " s (" << options.size << " x "
+			  << options.size << " x " << options.height << ")\n";
+
+	for(auto benchmarkCase : selected)
+		benchmarkCase->run(world, options);
+	return 0;
+}
@@ -0,0 +1,184 @@
+#include <iostream>
+#include <map>
+#include <random>
+#include <stdio.h>
+#include "world.hpp"
+#include "blockentity.hpp"
+#include "glstub.hpp"
+
+//Checks BlockEntityMap against a std::map through random sets and erases
+//(erasing shifts entries back in the table and compacts the payloads),
+//round trips it through serialize, then sets, ticks and reloads the
+//entities of a world that is saved to a file.
+//Usage: block_entities [file]
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+	if(!ok)
+	{
+		std::cerr << "FAILED: " << what << '\n';
+		failures++;
+	}
+}
+
+typedef std::map<uint32_t, std::pair<uint8_t, std::vector<uint8_t>>> ReferenceMap;
+
+static bool matches(const BlockEntityMap &map, const ReferenceMap &reference)
+{
+	if(map.size() != reference.size())
+		return false;
+	for(auto &[key, value] : reference)
+	{
+		const BlockEntity *entity = map.find(key);
+		if(!entity || entity->key != key || entity->block != value.first || entity->size != value.second.size() ||
+		   !std::equal(value.second.begin(), value.second.end(), map.payload(*entity)))
+			return false;
+	}
+	return true;
+}
+
+static void testMap()
+{
+	BlockEntityMap map;
+	ReferenceMap reference;
+	check(map.empty() && map.memoryUsage() == 0, "an empty map allocates nothing");
+	check(!map.find(0) && !map.erase(0), "an empty map has no entities");
+
+	//Keys from a few columns so that probe sequences overlap
+	//and erasing has to shift entries back
+	std::mt19937 rng(1);
+	for(int i = 0; i < 100000; i++)
+	{
+		uint32_t key = blockEntityKey(rng() % 4, rng() % 64, rng() % 4);
+		if(rng() % 3 != 0)
+		{
+			std::vector<uint8_t> data(rng() % 48);
+			for(auto &byte : data)
+				byte = rng();
+			uint8_t block = 1 + rng() % 8;
+			size_t expected = map.serializedSizeAfterSet(key, data.size());
+			map.set(key, block, data.data(), data.size());
+			reference[key] = { block, data };
+			if(map.serializedSize() != expected)
+			{
+				check(false, "serializedSizeAfterSet matches the size after set");
+				break;
+			}
+		}
+		else if(map.erase(key) != (reference.erase(key) > 0))
+		{
+			check(false, "erase finds the entities that are in the map");
+			break;
+		}
+
+		if(i % 1000 == 0 && !matches(map, reference))
+		{
+			check(false, "the map holds the same entities as a std::map");
+			break;
+		}
+	}
+	check(matches(map, reference), "the map holds the same entities as a std::map");
+	check(map.all().size() == map.size(), "all() returns every entity");
+
+	//Replaced payloads are garbage until the payloads are compacted,
+	//which keeps them to at most twice the live payload bytes
+	size_t live = 0;
+	for(auto &[key, value] : reference)
+		live += value.second.size();
+	//Count, then key, block and size before each payload
+	size_t payloadBytes = map.serializedSize() - sizeof(uint32_t) - map.size() * (2 * sizeof(uint32_t) + 1);
+	check(payloadBytes == live, "serializedSize only counts live payloads");
+	check(map.memoryUsage() < live * 2 + map.size() * (sizeof(BlockEntity) + 4 * sizeof(uint32_t)) + 4096,
+		  "garbage payloads are compacted");
+
+	std::vector<uint8_t> data(map.serializedSize());
+	map.serialize(data.data());
+	BlockEntityMap loaded;
+	check(loaded.deserialize(data.data(), data.size()) && matches(loaded, reference), "a map round trips through serialize");
+	check(!loaded.deserialize(data.data(), data.size() - 1) && loaded.empty(), "truncated data is refused");
+
+	for(auto &[key, value] : reference)
+		check(map.erase(key), "every entity can be erased");
+	check(map.empty() && map.memoryUsage() == 0, "a map that is emptied gives back its memory");
+}
+
+static void testWorld(const char *path)
+{
+	remove(path);
+	std::vector<uint8_t> data;
+	int32_t y;
+	{
+		World world(32, 128);
+		check(world.openWorldFile(path), "creating the world file");
+		world.generateWorld();
+		y = world.getHeight(3, 5);
+		check(!world.setBlockEntity(3, y + 1, 5, std::vector<uint8_t>{ 1, 2, 3 }), "air has no entities");
+		check(world.setBlockEntity(3, y, 5, std::vector<uint8_t>{ 1, 2, 3 }), "setting an entity");
+		check(world.getBlockEntity(3, y, 5, data) && data == std::vector<uint8_t>({ 1, 2, 3 }), "reading an entity back");
+
+		//The entity stays when the block is set to the same type and
+		//goes when it changes to another type
+		uint8_t block = world.getBlock(3, y, 5);
+		world.setBlock(3, y, 5, block);
+		check(world.getBlockEntity(3, y, 5, data), "setting the same block keeps its entity");
+		world.setBlock(3, y, 5, block == STONE ? DIRT : STONE);
+		check(!world.getBlockEntity(3, y, 5, data), "changing the block removes its entity");
+		world.setBlock(3, y, 5, block);
+		check(world.setBlockEntity(3, y, 5, std::vector<uint8_t>{ 1, 2, 3 }), "setting an entity again");
+		check(world.setBlockEntity(4, world.getHeight(4, 5), 5, std::vector<uint8_t>{ 9 }), "setting a second entity");
+
+		int ticked = 0;
+		world.tickBlockEntities(0, 0, [&](glm::ivec3 pos, uint8_t, std::span<uint8_t> payload) {
+			ticked++;
+			if(pos != glm::ivec3(3, y, 5))
+				return false;
+			payload[0] = 42;
+			return true;
+		});
+		check(ticked == 2, "ticking visits every entity of the chunk");
+		check(world.getBlockEntity(3, y, 5, data) && data[0] == 42, "ticking changes payloads in place");
+		world.syncWorldFile(true);
+	}
+
+	{
+		World world(32, 128);
+		check(world.openWorldFile(path), "opening the world file");
+		world.generateWorld();
+		check(world.getBlockEntity(3, y, 5, data) && data == std::vector<uint8_t>({ 42, 2, 3 }),
+			  "entities changed by a tick are saved");
+
+		check(world.removeBlockEntity(4, world.getHeight(4, 5), 5), "removing an entity");
+		check(!world.removeBlockEntity(4, world.getHeight(4, 5), 5), "removing an entity twice");
+
+		//A tick that reports no change is not saved
+		world.tickBlockEntities(0, 0, [](glm::ivec3, uint8_t, std::span<uint8_t> payload) {
+			payload[0] = 7;
+			return false;
+		});
+		world.syncWorldFile(true);
+	}
+
+	{
+		World world(32, 128);
+		check(world.openWorldFile(path), "opening the world file again");
+		world.generateWorld();
+		check(world.getBlockEntity(3, y, 5, data) && data[0] == 42, "a tick that changed nothing did not save");
+		check(!world.getBlockEntity(4, world.getHeight(4, 5), 5, data), "removed entities stay removed");
+	}
+	remove(path);
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : "block_entities.bgw";
+	stubOpenGL();
+	testMap();
+	testWorld(path);
+
+	if(failures > 0)
+		return 1;
+	std::cout << "ok\n";
+	return 0;
+}
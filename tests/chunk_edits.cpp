@@ -0,0 +1,46 @@
+#include <iostream>
+#include "chunk.hpp"
+
+//Box edits that reach above the top of a chunk: filling with air and
+//replacing blocks there has nothing to change, and used to index the
+//sections of a chunk that has none out of bounds
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+	if(!ok)
+	{
+		std::cerr << "FAILED: " << what << '\n';
+		failures++;
+	}
+}
+
+int main()
+{
+	{
+		Chunk chunk(0, 0);
+		chunk.fill(0, 0, 0, 15, 15, 15, AIR);
+		check(chunk.sections.empty(), "filling an empty chunk with air adds no sections");
+		check(chunk.version == 0, "filling an empty chunk with air does not change it");
+		chunk.replace(0, 0, 0, 15, 15, 15, STONE, BRICK);
+		check(chunk.sections.empty(), "replacing in an empty chunk adds no sections");
+	}
+
+	{
+		Chunk chunk(0, 0);
+		chunk.fill(0, 0, 0, 15, 15, 15, STONE);
+		chunk.fill(0, 40, 0, 15, 60, 15, AIR);
+		chunk.replace(0, 40, 0, 15, 60, 15, STONE, BRICK);
+		check(chunk.sections.size() == 1, "edits above the top of a chunk add no sections");
+		check(chunk.getBlock(3, 15, 3) == STONE, "edits above the top of a chunk leave its blocks alone");
+		chunk.replace(0, 8, 0, 15, 60, 15, STONE, BRICK);
+		check(chunk.getBlock(3, 15, 3) == BRICK && chunk.getBlock(3, 7, 3) == STONE,
+			  "replacing across the top of a chunk stops at the top");
+	}
+
+	if(failures > 0)
+		return 1;
+	std::cout << "ok\n";
+	return 0;
+}
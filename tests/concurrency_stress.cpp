@@ -0,0 +1,136 @@
+#include <iostream>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include "world.hpp"
+#include "glstub.hpp"
+
+//Edits and reads a world from several threads while the main thread
+//streams, meshes, compresses, deduplicates and saves chunks like a
+//frame of the game does. Meant to be run under ThreadSanitizer (the
+//concurrency_stress_tsan target), which reports any data race.
+//Usage: concurrency_stress [file] [frames]
+
+const int THREAD_COUNT = 4;
+
+//Random edits and reads around the middle of the world, each thread also
+//owns a column of blocks that nobody else writes and checks that it reads
+//back what it wrote
+static void editWorld(World &world, int thread, const std::atomic<bool> &stop, std::atomic<int> &failures)
+{
+	std::mt19937 rng(thread);
+	int32_t ownX = -200 + thread * 3, ownZ = 5;
+	uint32_t writes = 0;
+	while(!stop)
+	{
+		int32_t x = int32_t(rng() % 160) - 80, y = rng() % 128, z = int32_t(rng() % 160) - 80;
+		switch(rng() % 8)
+		{
+		case 0:
+			world.setBlock(x, y, z, rng() % 9);
+			break;
+		case 1:
+			world.fillRegion(glm::ivec3(x, y, z), glm::ivec3(x + 20, y + 3, z + 20), rng() % 9);
+			break;
+		case 2:
+			world.replaceInRegion(glm::ivec3(x, 0, z), glm::ivec3(x + 30, 127, z + 30), STONE, BRICK);
+			break;
+		case 3:
+		{
+			uint64_t faces[6][OCCUPANCY_WORDS];
+			world.getVisibleFaces(x / CHUNK_SIZE, y / CHUNK_SIZE, z / CHUNK_SIZE, faces);
+			break;
+		}
+		case 4:
+		{
+			BlockView view;
+			world.fillBlockView(view, x / CHUNK_SIZE, y / CHUNK_SIZE, z / CHUNK_SIZE);
+			if(rng() % 8 == 0)
+			{
+				Schematic copy = world.copyRegion(glm::ivec3(x, y, z), glm::ivec3(x + 20, y + 10, z + 20));
+				world.pasteRegion(copy, glm::ivec3(z, y, x), rng() % 4, rng() % 2);
+			}
+			break;
+		}
+		case 5:
+			world.getHeight(x, z);
+			world.isSolid(x, y, z);
+			if(rng() % 4 == 0)
+				world.redo();
+			break;
+		default:
+		{
+			//The column is only checked once its chunk exists
+			if(world.getHeight(ownX, ownZ) < 0)
+				break;
+			uint8_t block = 1 + writes++ % 8;
+			world.setBlock(ownX, 120, ownZ, block);
+			if(world.getBlock(ownX, 120, ownZ) != block)
+				failures++;
+			break;
+		}
+		}
+		world.getBlock(x, y, z);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : "concurrency_stress.bgw";
+	int frames = argc > 2 ? atoi(argv[2]) : 60;
+	stubOpenGL();
+	remove(path);
+
+	std::atomic<int> failures(0);
+	{
+		World world(64, 128);
+		if(!world.openWorldFile(path))
+		{
+			std::cerr << "Failed to create " << path << '\n';
+			return 1;
+		}
+		world.generateWorld();
+		world.buildAllChunks();
+
+		std::atomic<bool> stop(false);
+		std::vector<std::thread> threads;
+		for(int i = 0; i < THREAD_COUNT; i++)
+			threads.emplace_back(editWorld, std::ref(world), i, std::cref(stop), std::ref(failures));
+
+		double now = 0.0;
+		for(int frame = 0; frame < frames; frame++)
+		{
+			//Walk away from the middle so new chunks are generated while
+			//the other threads edit the ones that are already there
+			world.generateChunksAround(-10 - frame / 4, 0, 4 + frame / 6, 16);
+			world.buildDirtyChunks();
+			now += 1.0;
+			world.compressColdChunks(now, frame % 3 == 0 ? 0.0 : 100.0);
+			world.memoryStats();
+			world.coldChunkStats();
+			if(frame % 7 == 0)
+			{
+				world.startDedupSections();
+				world.sectionDedupStats();
+			}
+			if(frame % 10 == 0)
+				world.syncWorldFile(false);
+		}
+
+		stop = true;
+		for(auto &thread : threads)
+			thread.join();
+		world.buildDirtyChunks();
+	}
+	remove(path);
+
+	if(failures > 0)
+	{
+		std::cerr << failures << " writes were not read back by the thread that made them\n";
+		return 1;
+	}
+	return 0;
+}
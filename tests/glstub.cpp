@@ -0,0 +1,53 @@
+#include "glstub.hpp"
+#include <glad/glad.h>
+
+//OpenGL is only used from one thread, so this does not need a lock
+static GLuint nextName = 1;
+
+static void genObjects(GLsizei count, GLuint *names)
+{
+	for(GLsizei i = 0; i < count; i++)
+		names[i] = nextName++;
+}
+
+static void deleteObjects(GLsizei, const GLuint*)
+{
+}
+
+static void bindVertexArray(GLuint)
+{
+}
+
+static void bindBuffer(GLenum, GLuint)
+{
+}
+
+static void bufferData(GLenum, GLsizeiptr, const void*, GLenum)
+{
+}
+
+static void vertexAttribPointer(GLuint, GLint, GLenum, GLboolean, GLsizei, const void*)
+{
+}
+
+static void enableVertexAttribArray(GLuint)
+{
+}
+
+static void drawArrays(GLenum, GLint, GLsizei)
+{
+}
+
+void stubOpenGL()
+{
+	glad_glGenBuffers = genObjects;
+	glad_glGenVertexArrays = genObjects;
+	glad_glDeleteBuffers = deleteObjects;
+	glad_glDeleteVertexArrays = deleteObjects;
+	glad_glBindVertexArray = bindVertexArray;
+	glad_glBindBuffer = bindBuffer;
+	glad_glBufferData = bufferData;
+	glad_glVertexAttribPointer = vertexAttribPointer;
+	glad_glEnableVertexAttribArray = enableVertexAttribArray;
+	glad_glDrawArrays = drawArrays;
+}
@@ -0,0 +1,10 @@
+#ifndef __GLSTUB_H__
+
+//Points the OpenGL functions that World uses at functions that do
+//nothing, so that worlds can be generated and meshed without a window.
+//Objects get unique names and uploads are thrown away
+void stubOpenGL();
+
+#endif
+
+#define __GLSTUB_H__
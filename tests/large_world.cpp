@@ -0,0 +1,113 @@
+#include <iostream>
+#include <random>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include "world.hpp"
+#include "glstub.hpp"
+
+//Generates a world with more than 4 GiB of block data (4608 x 4608 x 256,
+//5 GiB, by default), saves it to a world file, loads it back and checks that
+//the blocks and a set of edits survived the round trip.
+//Usage: large_world [file] [size] [height]
+//The file takes up about 1.6 GiB of disk with the default size, sections
+//that are all air are not stored
+
+//Number of random blocks that are compared after loading
+const size_t SAMPLE_COUNT = 1 << 20;
+//Number of random blocks that are changed before saving
+const size_t EDIT_COUNT = 1 << 14;
+
+static std::vector<glm::ivec3> randomPositions(size_t count, uint32_t size, uint32_t height, uint32_t seed)
+{
+	std::mt19937 rng(seed);
+	std::vector<glm::ivec3> positions(count);
+	for(auto &pos : positions)
+		pos = glm::ivec3(int32_t(rng() % size) - int32_t(size / 2),
+						 int32_t(rng() % height),
+						 int32_t(rng() % size) - int32_t(size / 2));
+	return positions;
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : "large_world.bgw";
+	uint32_t size = argc > 2 ? atoi(argv[2]) : 4608,
+			 height = argc > 3 ? atoi(argv[3]) : 256;
+	stubOpenGL();
+	remove(path);
+
+	std::vector<glm::ivec3> samples = randomPositions(SAMPLE_COUNT, size, height, 1),
+							edits = randomPositions(EDIT_COUNT, size, height, 2);
+	std::vector<uint8_t> sampleBlocks(SAMPLE_COUNT), editBlocks(EDIT_COUNT);
+	for(size_t i = 0; i < EDIT_COUNT; i++)
+		editBlocks[i] = i % 8 + 1;
+
+	BlockHistogram histogram;
+	glm::ivec3 minPos(-int32_t(size / 2), 0, -int32_t(size / 2)),
+			   maxPos(int32_t(size / 2) - 1, int32_t(height) - 1, int32_t(size / 2) - 1);
+	{
+		World world(size, height);
+		if(!world.openWorldFile(path))
+		{
+			std::cerr << "Failed to create " << path << '\n';
+			return 1;
+		}
+		world.generateWorld();
+
+		size_t denseBytes = world.denseMemoryUsage();
+		std::cerr << "Dense block data: " << denseBytes / (1024 * 1024) << " MiB\n";
+		if(argc <= 2 && denseBytes <= (size_t(4) << 30))
+		{
+			std::cerr << "World is not larger than 4 GiB\n";
+			return 1;
+		}
+
+		world.setBlocks(edits, editBlocks);
+		//Later edits to the same position win
+		world.getBlocks(edits, editBlocks);
+		world.getBlocks(samples, sampleBlocks);
+		histogram = world.blockHistogram(minPos, maxPos);
+	}
+
+	World world(size, height);
+	if(!world.openWorldFile(path))
+	{
+		std::cerr << "Failed to reopen " << path << '\n';
+		return 1;
+	}
+	world.generateWorld();
+
+	std::vector<uint8_t> blocks(SAMPLE_COUNT);
+	world.getBlocks(samples, blocks);
+	for(size_t i = 0; i < SAMPLE_COUNT; i++)
+	{
+		if(blocks[i] != sampleBlocks[i])
+		{
+			std::cerr << "Block at " << samples[i].x << ", " << samples[i].y << ", " << samples[i].z
+					  << " is " << int(blocks[i]) << " after loading, expected " << int(sampleBlocks[i]) << '\n';
+			return 1;
+		}
+	}
+
+	blocks.resize(EDIT_COUNT);
+	world.getBlocks(edits, blocks);
+	for(size_t i = 0; i < EDIT_COUNT; i++)
+	{
+		if(blocks[i] != editBlocks[i])
+		{
+			std::cerr << "Edit at " << edits[i].x << ", " << edits[i].y << ", " << edits[i].z
+					  << " was lost\n";
+			return 1;
+		}
+	}
+
+	if(world.blockHistogram(minPos, maxPos) != histogram)
+	{
+		std::cerr << "Block counts changed after loading\n";
+		return 1;
+	}
+
+	remove(path);
+	return 0;
+}
@@ -0,0 +1,153 @@
+#include <iostream>
+#include <algorithm>
+#include <random>
+#include <tuple>
+#include "world.hpp"
+#include "blockquery.hpp"
+#include "glstub.hpp"
+
+//Checks the region queries and the section kernels they run on against
+//plain loops over getBlock, on random boxes that cross chunk and section
+//borders and reach past the edges of the world.
+//Air is left out of the comparison, the queries skip chunks that have not
+//been generated and the sections above the top of a chunk
+
+const int32_t WORLD_SIZE = 64, WORLD_HEIGHT = 128;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+	if(!ok)
+	{
+		std::cerr << "FAILED: " << what << '\n';
+		failures++;
+	}
+}
+
+static bool lessPos(const glm::ivec3 &a, const glm::ivec3 &b)
+{
+	return std::tie(a.x, a.y, a.z) < std::tie(b.x, b.y, b.z);
+}
+
+static void testKernels()
+{
+	std::mt19937 rng(2);
+	uint8_t blocks[SECTION_VOLUME];
+	for(auto &block : blocks)
+		block = rng() % 4;
+
+	for(int i = 0; i < 200; i++)
+	{
+		SectionBox box;
+		box.minX = rng() % CHUNK_SIZE;
+		box.minY = rng() % CHUNK_SIZE;
+		box.minZ = rng() % CHUNK_SIZE;
+		box.maxX = box.minX + rng() % (CHUNK_SIZE - box.minX);
+		box.maxY = box.minY + rng() % (CHUNK_SIZE - box.minY);
+		box.maxZ = box.minZ + rng() % (CHUNK_SIZE - box.minZ);
+		uint8_t block = rng() % 4;
+
+		uint32_t count = 0;
+		std::vector<glm::ivec3> expected;
+		for(int32_t y = box.minY; y <= box.maxY; y++)
+		{
+			for(int32_t z = box.minZ; z <= box.maxZ; z++)
+			{
+				const uint8_t *row = blocks + chunkBlockIndex(0, y, z);
+				uint32_t mask = 0;
+				for(int32_t x = 0; x < CHUNK_SIZE; x++)
+					if(blocks[chunkBlockIndex(x, y, z)] == block)
+						mask |= 1u << x;
+				if(matchRow(row, block) != mask)
+				{
+					check(false, "matchRow matches a scalar loop");
+					return;
+				}
+
+				for(int32_t x = box.minX; x <= box.maxX; x++)
+				{
+					if(blocks[chunkBlockIndex(x, y, z)] == block)
+					{
+						count++;
+						expected.push_back(glm::ivec3(x, y, z) + glm::ivec3(16, -32, 48));
+					}
+				}
+			}
+		}
+
+		check(countInSection(blocks, box, block) == count, "countInSection matches a scalar loop");
+		std::vector<glm::ivec3> found;
+		findInSection(blocks, box, block, glm::ivec3(16, -32, 48), found);
+		check(found == expected, "findInSection finds blocks in y, z, x order");
+
+		BlockHistogram histogram = {};
+		addSectionHistogram(blocks, box, { 0, 1, 2, 3 }, histogram);
+		check(histogram[block] == count && box.volume() == histogram[0] + histogram[1] + histogram[2] + histogram[3],
+			  "addSectionHistogram matches a scalar loop");
+	}
+}
+
+static void testWorld()
+{
+	World world(WORLD_SIZE, WORLD_HEIGHT);
+	world.generateWorld();
+	//Some blocks that generation does not make
+	world.fillRegion(glm::ivec3(-5, 60, -5), glm::ivec3(5, 64, 5), BRICK);
+	world.setBlock(17, 100, -17, BRICK);
+
+	std::mt19937 rng(3);
+	for(int i = 0; i < 40; i++)
+	{
+		glm::ivec3 pos1(int32_t(rng() % 100) - 50, int32_t(rng() % 160) - 16, int32_t(rng() % 100) - 50),
+				   pos2 = pos1 + glm::ivec3(int32_t(rng() % 40) - 20, int32_t(rng() % 80) - 40, int32_t(rng() % 40) - 20);
+		glm::ivec3 minPos = glm::min(pos1, pos2), maxPos = glm::max(pos1, pos2);
+
+		BlockHistogram expected = {};
+		std::vector<glm::ivec3> bricks;
+		for(int32_t y = minPos.y; y <= maxPos.y; y++)
+		{
+			for(int32_t z = minPos.z; z <= maxPos.z; z++)
+			{
+				for(int32_t x = minPos.x; x <= maxPos.x; x++)
+				{
+					uint8_t block = world.getBlock(x, y, z);
+					expected[block]++;
+					if(block == BRICK)
+						bricks.push_back(glm::ivec3(x, y, z));
+				}
+			}
+		}
+
+		BlockHistogram histogram = world.blockHistogram(pos1, pos2);
+		bool same = true;
+		for(uint32_t block = 1; block < histogram.size(); block++)
+			same = same && histogram[block] == expected[block];
+		check(same, "blockHistogram matches getBlock");
+		check(world.countBlocks(pos2, pos1, STONE) == expected[STONE], "countBlocks matches getBlock");
+		check(world.countBlocks(pos1, pos2, DIRT) == expected[DIRT], "countBlocks matches getBlock");
+
+		std::vector<glm::ivec3> found = world.findBlocks(pos1, pos2, BRICK);
+		std::sort(found.begin(), found.end(), lessPos);
+		std::sort(bricks.begin(), bricks.end(), lessPos);
+		check(found == bricks, "findBlocks finds every block getBlock does");
+	}
+
+	check(world.countBlocks(glm::ivec3(-5, 60, -5), glm::ivec3(5, 64, 5), BRICK) == 11 * 5 * 11, "counting a filled box");
+	check(world.findBlocks(glm::ivec3(0, 0, 0), glm::ivec3(-40, 127, -40), BRICK).size() == 6 * 5 * 6,
+		  "finding a filled box");
+	check(world.countBlocks(glm::ivec3(1000, 0, 1000), glm::ivec3(1010, 127, 1010), STONE) == 0,
+		  "chunks that have not been generated are skipped");
+}
+
+int main()
+{
+	stubOpenGL();
+	testKernels();
+	testWorld();
+
+	if(failures > 0)
+		return 1;
+	std::cout << "ok\n";
+	return 0;
+}
@@ -0,0 +1,106 @@
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include "schematic.hpp"
+#include "blocks.hpp"
+
+//Saves, loads, turns and flips schematics and checks that nothing is lost,
+//and that load refuses files with a bad size or blocks that do not exist.
+//Usage: schematic_roundtrip [file]
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+	if(!ok)
+	{
+		std::cerr << "FAILED: " << what << '\n';
+		failures++;
+	}
+}
+
+static bool sameBlocks(const Schematic &a, const Schematic &b)
+{
+	return a.size == b.size && a.blocks == b.blocks;
+}
+
+//Overwrites bytes of a saved file
+static bool patchFile(const char *path, long offset, const void *bytes, size_t count)
+{
+	FILE *file = fopen(path, "r+b");
+	if(!file)
+		return false;
+	bool ok = fseek(file, offset, SEEK_SET) == 0 && fwrite(bytes, 1, count, file) == count;
+	return fclose(file) == 0 && ok;
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : "schematic_roundtrip.bgsc";
+
+	//Uneven sides so that turning it changes its size, with runs
+	//of the same block and blocks that change every step
+	Schematic schematic(glm::ivec3(5, 3, 7));
+	for(int32_t y = 0; y < schematic.size.y; y++)
+		for(int32_t z = 0; z < schematic.size.z; z++)
+			for(int32_t x = 0; x < schematic.size.x; x++)
+				schematic.blocks[schematic.index(x, y, z)] = y == 0 ? uint8_t(STONE) : uint8_t((x * 3 + z * 5 + y) % BLOCK_TYPE_COUNT);
+
+	{
+		Schematic turned = schematic.rotated(1);
+		check(turned.size == glm::ivec3(7, 3, 5), "a quarter turn swaps the x and z sizes");
+		//(x, z) -> (size.z - 1 - z, x)
+		check(turned.getBlock(7 - 1 - 2, 1, 4) == schematic.getBlock(4, 1, 2), "a quarter turn moves blocks clockwise");
+		check(sameBlocks(schematic.rotated(2), turned.rotated(1)), "two quarter turns are a half turn");
+		check(sameBlocks(schematic.rotated(3).rotated(1), schematic), "four quarter turns change nothing");
+		check(sameBlocks(schematic.rotated(4), schematic), "turns wrap around");
+
+		Schematic flipped = schematic.mirrored();
+		check(flipped.getBlock(0, 2, 3) == schematic.getBlock(4, 2, 3), "mirroring flips along x");
+		check(sameBlocks(flipped.mirrored(), schematic), "mirroring twice changes nothing");
+	}
+
+	{
+		Schematic loaded;
+		check(schematic.save(path), "saving a schematic");
+		check(loaded.load(path) && sameBlocks(loaded, schematic), "a saved schematic loads back the same");
+
+		Schematic turned = schematic.rotated(3).mirrored();
+		check(turned.save(path), "saving a turned schematic");
+		check(loaded.load(path) && sameBlocks(loaded, turned), "a turned schematic loads back the same");
+
+		Schematic empty;
+		check(empty.save(path) && loaded.load(path) && loaded.size == glm::ivec3(0), "an empty schematic round trips");
+	}
+
+	//Header: magic, version, 3 sizes, padding, encoded size,
+	//then pairs of (run length - 1, block)
+	const long SIZE_OFFSET = 8, BLOCKS_OFFSET = 32;
+	{
+		check(schematic.save(path), "saving a schematic to break");
+		int32_t size[3] = { 4096, 4096, 4096 };
+		check(patchFile(path, SIZE_OFFSET, size, sizeof(size)), "writing a huge size");
+		Schematic loaded;
+		check(!loaded.load(path), "a schematic over the volume limit is refused");
+		check(loaded.blocks.empty(), "a refused schematic is left alone");
+	}
+
+	{
+		check(schematic.save(path), "saving a schematic to break");
+		uint8_t block = uint8_t(BLOCK_TYPE_COUNT);
+		check(patchFile(path, BLOCKS_OFFSET + 1, &block, 1), "writing an unknown block");
+		Schematic loaded;
+		check(!loaded.load(path), "a schematic with an unknown block is refused");
+	}
+
+	{
+		Schematic loaded;
+		check(!loaded.load("schematic_roundtrip_missing.bgsc"), "a missing file is refused");
+	}
+	remove(path);
+
+	if(failures > 0)
+		return 1;
+	std::cout << "ok\n";
+	return 0;
+}
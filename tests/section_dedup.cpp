@@ -0,0 +1,135 @@
+#include <iostream>
+#include <random>
+#include <string.h>
+#include "world.hpp"
+#include "sectiontable.hpp"
+#include "glstub.hpp"
+
+//Sections with the same blocks share one copy of their data after being
+//deduplicated. Checks that changing one of them gives it its own copy and
+//leaves the others alone, for single sections and for a whole world
+
+const int32_t WORLD_SIZE = 64, WORLD_HEIGHT = 128;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+	if(!ok)
+	{
+		std::cerr << "FAILED: " << what << '\n';
+		failures++;
+	}
+}
+
+static bool hasBlocks(const ChunkSection &section, const uint8_t *blocks)
+{
+	uint8_t decoded[SECTION_VOLUME];
+	section.getBlocks(decoded);
+	return memcmp(decoded, blocks, SECTION_VOLUME) == 0;
+}
+
+static void testSections()
+{
+	std::mt19937 rng(4);
+	uint8_t blocks[SECTION_VOLUME];
+	for(auto &block : blocks)
+		block = rng() % 3 == 0 ? STONE : AIR;
+
+	ChunkSection a, b, other;
+	a.setBlocks(blocks);
+	b.setBlocks(blocks);
+	other.setBlocks(blocks);
+	other.setBlock(1, 2, 3, BRICK);
+	check(a.dataId() != b.dataId(), "sections start with their own data");
+
+	{
+		SectionTable table;
+		table.intern(a);
+		table.intern(b);
+		table.intern(other);
+		check(a.dataId() == b.dataId(), "sections with the same blocks share their data");
+		check(other.dataId() != a.dataId(), "sections with other blocks do not");
+		check(hasBlocks(a, blocks) && hasBlocks(b, blocks), "sharing data does not change the blocks");
+
+		//The table holds a copy as well
+		uint32_t shared = a.shareCount();
+		b.setBlock(5, 6, 7, BRICK);
+		check(a.dataId() != b.dataId(), "changing a shared section gives it its own data");
+		check(a.shareCount() == shared - 1, "the changed section lets go of the shared data");
+		check(hasBlocks(a, blocks), "changing a shared section leaves the others alone");
+		check(b.getBlock(5, 6, 7) == BRICK && b.isOpaque(5, 6, 7), "the changed section has the new block");
+		check(a.getBlock(5, 6, 7) == blocks[chunkBlockIndex(5, 6, 7)] && a.isOpaque(5, 6, 7) == (blocks[chunkBlockIndex(5, 6, 7)] == STONE),
+			  "the other sections keep their blocks and occupancy");
+
+		b.setBlock(5, 6, 7, blocks[chunkBlockIndex(5, 6, 7)]);
+		table.intern(b);
+		check(a.dataId() == b.dataId(), "a section changed back can share again");
+	}
+	check(hasBlocks(a, blocks) && hasBlocks(b, blocks), "sections keep their data when the table goes away");
+
+	//Copies share data as well and diverge the same way
+	ChunkSection copy = a;
+	check(copy.dataId() == a.dataId(), "copies share their data");
+	copy.setBlock(3, 0, 3, DIRT);
+	check(hasBlocks(a, blocks) && copy.getBlock(3, 0, 3) == DIRT, "changing a copy leaves the original alone");
+}
+
+static void testWorld()
+{
+	World world(WORLD_SIZE, WORLD_HEIGHT);
+	world.generateWorld();
+	//Copies of a chunk next to it, lined up with
+	//the sections so that they have the same blocks
+	Schematic chunk = world.copyRegion(glm::ivec3(0, 0, 0), glm::ivec3(CHUNK_SIZE - 1, WORLD_HEIGHT - 1, CHUNK_SIZE - 1));
+	world.pasteRegion(chunk, glm::ivec3(CHUNK_SIZE, 0, 0));
+	world.pasteRegion(chunk, glm::ivec3(-CHUNK_SIZE, 0, 0));
+	world.dedupSections();
+	SectionDedupStats stats = world.sectionDedupStats();
+	check(stats.distinctData < stats.dataSections, "copied chunks share their section data");
+
+	std::vector<uint8_t> expected(size_t(WORLD_SIZE) * WORLD_SIZE * WORLD_HEIGHT);
+	auto index = [](int32_t x, int32_t y, int32_t z) {
+		return (size_t(y) * WORLD_SIZE + size_t(z + WORLD_SIZE / 2)) * WORLD_SIZE + size_t(x + WORLD_SIZE / 2);
+	};
+	for(int32_t y = 0; y < WORLD_HEIGHT; y++)
+		for(int32_t z = -WORLD_SIZE / 2; z < WORLD_SIZE / 2; z++)
+			for(int32_t x = -WORLD_SIZE / 2; x < WORLD_SIZE / 2; x++)
+				expected[index(x, y, z)] = world.getBlock(x, y, z);
+
+	//Edit the world, deduplicate it again and edit it some
+	//more, every block has to stay what it was set to
+	std::mt19937 rng(5);
+	for(int pass = 0; pass < 2; pass++)
+	{
+		for(int i = 0; i < 20000; i++)
+		{
+			int32_t x = int32_t(rng() % WORLD_SIZE) - WORLD_SIZE / 2,
+					y = rng() % WORLD_HEIGHT,
+					z = int32_t(rng() % WORLD_SIZE) - WORLD_SIZE / 2;
+			uint8_t block = rng() % 4 == 0 ? uint8_t(BRICK) : expected[index(x, y, z)];
+			world.setBlock(x, y, z, block);
+			expected[index(x, y, z)] = block;
+		}
+		world.dedupSections();
+	}
+
+	bool same = true;
+	for(int32_t y = 0; y < WORLD_HEIGHT && same; y++)
+		for(int32_t z = -WORLD_SIZE / 2; z < WORLD_SIZE / 2 && same; z++)
+			for(int32_t x = -WORLD_SIZE / 2; x < WORLD_SIZE / 2 && same; x++)
+				same = world.getBlock(x, y, z) == expected[index(x, y, z)];
+	check(same, "edits to sections that share data only change the edited section");
+}
+
+int main()
+{
+	stubOpenGL();
+	testSections();
+	testWorld();
+
+	if(failures > 0)
+		return 1;
+	std::cout << "ok\n";
+	return 0;
+}
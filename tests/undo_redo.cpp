@@ -0,0 +1,156 @@
+#include <iostream>
+#include "world.hpp"
+#include "editjournal.hpp"
+#include "glstub.hpp"
+
+//Undoes and redoes edits to a small world and checks that every step
+//brings back exactly the blocks from before it, and that the history
+//stays under its limit: the oldest steps are dropped first and an edit
+//too large to record clears the history
+
+const int32_t WORLD_SIZE = 64, WORLD_HEIGHT = 128;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+	if(!ok)
+	{
+		std::cerr << "FAILED: " << what << '\n';
+		failures++;
+	}
+}
+
+static uint64_t hashWorld(World &world)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for(int32_t y = 0; y < WORLD_HEIGHT; y++)
+	{
+		for(int32_t z = -WORLD_SIZE / 2; z < WORLD_SIZE / 2; z++)
+		{
+			for(int32_t x = -WORLD_SIZE / 2; x < WORLD_SIZE / 2; x++)
+			{
+				hash ^= world.getBlock(x, y, z);
+				hash *= 1099511628211ull;
+			}
+		}
+	}
+	return hash;
+}
+
+static void testJournal()
+{
+	EditJournal journal;
+	journal.record(0, 0, 0, STONE, STONE);
+	journal.commit();
+	check(journal.undoCount() == 0, "changes that do not change the block are not recorded");
+
+	//Runs along x are merged
+	for(int32_t x = 0; x < 8; x++)
+		journal.record(x, 1, 2, AIR, BRICK);
+	journal.commit();
+	const EditTransaction *transaction = journal.takeUndo();
+	check(transaction && transaction->runs.size() == 1 && transaction->runs[0].length == 8,
+		  "blocks next to each other along x are one run");
+	check(transaction && transaction->minPos == glm::ivec3(0, 1, 2) && transaction->maxPos == glm::ivec3(7, 1, 2),
+		  "a transaction keeps the box around its blocks");
+	check(journal.undoCount() == 0 && journal.redoCount() == 1, "undoing moves a step to the redo history");
+	check(journal.takeRedo() && journal.undoCount() == 1 && journal.redoCount() == 0, "redoing moves it back");
+
+	//Every step uses about the same memory, the limit
+	//fits three of them so older ones are dropped
+	journal.clear();
+	for(int32_t i = 0; i < 3; i++)
+	{
+		for(int32_t x = 0; x < 100; x++)
+			journal.record(x * 2, i, 0, AIR, STONE);
+		journal.commit();
+	}
+	size_t stepBytes = journal.memoryUsage() / 3;
+	journal.setLimit(stepBytes * 3 + stepBytes / 2);
+	check(journal.undoCount() == 3, "steps that fit the limit are kept");
+	for(int32_t x = 0; x < 100; x++)
+		journal.record(x * 2, 3, 0, AIR, STONE);
+	journal.commit();
+	check(journal.undoCount() == 3, "the oldest step is dropped to make room");
+	check(journal.memoryUsage() <= stepBytes * 3 + stepBytes / 2, "the history stays under its limit");
+
+	//A new edit clears the redo history
+	journal.takeUndo();
+	check(journal.redoCount() == 1, "an undone step can be redone");
+	journal.record(0, 10, 0, AIR, STONE);
+	journal.commit();
+	check(journal.redoCount() == 0, "a new edit clears the redo history");
+
+	//An edit over the limit cannot be undone and older steps
+	//could be undone on top of the wrong blocks, so all go
+	for(int32_t x = 0; x < 10000; x++)
+		journal.record(x * 2, 20, 0, AIR, STONE);
+	journal.commit();
+	check(journal.undoCount() == 0 && journal.redoCount() == 0, "an edit over the limit clears the history");
+	check(journal.memoryUsage() == EditTransaction().memoryUsage(), "a cleared history holds no blocks");
+	journal.record(0, 30, 0, AIR, STONE);
+	journal.commit();
+	check(journal.undoCount() == 1, "edits are recorded again after an overflow");
+}
+
+static void testWorld()
+{
+	World world(WORLD_SIZE, WORLD_HEIGHT);
+	world.generateWorld();
+	world.buildAllChunks();
+
+	uint64_t generated = hashWorld(world);
+	check(!world.undo() && !world.redo(), "generating the world is not an undo step");
+
+	world.fillRegion(glm::ivec3(-20, 40, -20), glm::ivec3(19, 70, 19), BRICK);
+	uint64_t filled = hashWorld(world);
+	world.setBlock(0, 100, 0, LOG);
+	uint64_t placed = hashWorld(world);
+
+	//Placing a block that is already there changes nothing
+	world.setBlock(0, 100, 0, LOG);
+	check(world.undo() && hashWorld(world) == filled, "undoing a block edit");
+	check(world.undo() && hashWorld(world) == generated, "undoing a box edit");
+	check(!world.undo(), "nothing is left to undo");
+	check(world.redo() && hashWorld(world) == filled, "redoing a box edit");
+	check(world.redo() && hashWorld(world) == placed, "redoing a block edit");
+	check(!world.redo(), "nothing is left to redo");
+
+	//Grouped edits are one step, even if they change a block twice
+	world.beginEdit();
+	world.setBlock(3, 110, 3, STONE);
+	world.setBlock(3, 110, 3, DIRT);
+	world.replaceInRegion(glm::ivec3(-30, 0, -30), glm::ivec3(29, 127, 29), BRICK, WOOD);
+	check(!world.undo(), "undo waits for an open group");
+	world.endEdit();
+	check(world.undo() && hashWorld(world) == placed, "undoing a group restores the blocks from before it");
+	check(world.redo() && world.getBlock(3, 110, 3) == DIRT && world.getBlock(0, 50, 0) == WOOD,
+		  "redoing a group applies its last blocks");
+
+	//Pastes are undone like any other edit
+	uint64_t beforePaste = hashWorld(world);
+	Schematic copy = world.copyRegion(glm::ivec3(-10, 30, -10), glm::ivec3(10, 80, 10));
+	world.pasteRegion(copy, glm::ivec3(-25, 20, -5), 1, true);
+	check(world.undo() && hashWorld(world) == beforePaste, "undoing a paste");
+
+	world.setBlock(1, 115, 1, STONE);
+	check(!world.redo(), "a new edit clears the redo history");
+
+	world.setUndoLimit(100000);
+	world.fillRegion(glm::ivec3(-30, 0, -30), glm::ivec3(29, 60, 29), AIR);
+	check(!world.undo(), "an edit over the undo limit clears the history");
+	check(world.memoryStats().undoHistoryBytes <= 100000, "the undo history stays under its limit");
+}
+
+int main()
+{
+	stubOpenGL();
+	testJournal();
+	testWorld();
+
+	if(failures > 0)
+		return 1;
+	std::cout << "ok\n";
+	return 0;
+}